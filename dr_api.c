@@ -1,4 +1,3 @@
-//TODO: Split horizon implement
 /* Filename: dr_api.c */
 
 /* include files */
@@ -10,8 +9,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "dr_api.h"
+#include "dr_convtrace.h"
+#include "dr_damping.h"
+#include "dr_sendq.h"
+#include "dr_trace.h"
 #include "rmutex.h"
 
 /* internal data structures */
@@ -28,17 +33,26 @@
 #define RIP_GARBAGE_SEC 20
 
 #define IPV4_ADDR_FAM 1 //NOTE: Not sure if needed
+#define RIP_MAX_ECMP_PATHS DR_MAX_NEXT_HOPS /* max. number of equal-cost next hops per route */
+#define RIP_MAX_ENTRIES 25   /* max. number of entries in one RIP packet (RFC 2453) */
+#define ADDR_FAM_UNSPEC 0    /* a request for the whole table uses family 0 */
 #define DEBUG 1
+#define MAX_ROUTE_LISTENERS 4
+#define WITHDRAW_LOG_SIZE 64 /* withdrawals remembered for dr_dump_table */
+#define STATS_DUMP_TICKS 30 /* periodic callbacks between statistics dumps */
 
 /** information about a route which is sent with a RIP packet */
 typedef struct rip_entry_t {
     uint16_t addr_family;
-    uint16_t pad;
+    uint16_t pad;           /* hops from the origin, if tracing convergence */
     uint32_t ip;
     uint32_t subnet_mask;
     uint32_t next_hop;
     uint32_t metric;
-    uint32_t learned_from;
+#ifdef DR_CONVERGENCE_TRACE
+    uint32_t origin_id;     /* router where this change originated */
+    uint64_t origin_ns;     /* when it did, see dr_convtrace.h */
+#endif
 } __attribute__ ((packed)) rip_entry_t;
 
 /** the RIP payload header */
@@ -49,17 +63,32 @@ typedef struct rip_header_t {
     rip_entry_t entries[0];
 } __attribute__ ((packed)) rip_header_t;
 
+/** one of the equal-cost next hops of a route */
+typedef struct path_t {
+    uint32_t next_hop_ip;   /* neighbour to forward to on this path */
+    uint32_t outgoing_intf; /* interface leading to that neighbour */
+} path_t;
+
 /** a single entry in the routing table */
 typedef struct route_t {
     uint32_t subnet;        /* destination subnet which this route is for */
     uint32_t mask;          /* mask associated with this route */
-    uint32_t next_hop_ip;   /* next hop on on this route */
+    uint32_t next_hop_ip;   /* next hop on on this route (same as paths[0]) */
     uint32_t outgoing_intf; /* interface to use to send packets on this route */
     uint32_t cost;
-    uint32_t learned_from;
     struct timeval last_updated;
 
+    path_t paths[RIP_MAX_ECMP_PATHS]; /* all next hops with cost == this->cost */
+    uint32_t num_paths;
+
     int is_garbage; /* boolean which notes whether this entry is garbage */
+    uint64_t seq;   /* sequence number of the last change to this route */
+    uint32_t view_slot; /* index of this route in the interface views */
+#ifdef DR_CONVERGENCE_TRACE
+    uint32_t origin_id; /* where and when the last change to this route */
+    uint64_t origin_ns; /* originated, and how many hops it took to here */
+    uint16_t hops;
+#endif
 
     route_t* next;  /* pointer to the next route in a linked-list */
 } route_t;
@@ -67,12 +96,44 @@ typedef struct route_t {
 
 /* internal variables */
 
-/* a very coarse recursive mutex to synchronize access to methods */
-static rmutex_t coarse_lock;
-
-/** how mlong to sleep between periodic callbacks */
-static unsigned secs_to_sleep_between_callbacks;
-static unsigned nanosecs_to_sleep_between_callbacks;
+/* a very coarse recursive mutex to synchronize access to methods; initialized
+ * statically as some of them may be called before dr_init */
+static rmutex_t coarse_lock = RMUTEX_INITIALIZER;
+
+/* subscribers to routing table changes, see dr_register_route_listener */
+static dr_route_listener_t route_listeners[MAX_ROUTE_LISTENERS];
+static void* route_listener_ctx[MAX_ROUTE_LISTENERS];
+static unsigned num_route_listeners = 0;
+static uint64_t route_seq = 0;
+
+/* the latest withdrawals (a ring) for resyncing listeners with dr_dump_table;
+ * withdrawals up to and including withdraw_log_floor have been overwritten */
+static dr_route_event_t withdraw_log[WITHDRAW_LOG_SIZE];
+static unsigned withdraw_log_next = 0;
+static uint64_t withdraw_log_floor = 0;
+
+/* What each interface advertises, kept up to date as routes change: slot k of
+ * every view describes view_routes[k], with split horizon and poisoned reverse
+ * already applied for that interface.  Full tables go out straight from here. */
+static rip_entry_t **intf_views = NULL;
+static uint32_t num_intf_views = 0;
+static route_t **view_routes = NULL;
+static uint32_t num_view_routes = 0;
+static uint32_t max_view_routes = 0;
+
+#ifdef DR_CONVERGENCE_TRACE
+static uint32_t router_id;         /* our lowest interface IP */
+static uint64_t packet_arrival_ns; /* when the packet being handled was handed to us */
+#define TRACE_ORIGINATE(route) trace_originate(route)
+#define TRACE_INSTALL(route, received) trace_install(route, received)
+#else
+#define TRACE_ORIGINATE(route) ((void) 0)
+#define TRACE_INSTALL(route, received) ((void) 0)
+#endif
+
+/** how long to sleep between periodic callbacks, see dr_configure_timing */
+static dr_timing_config_t timing = { 1000, 250, 1000 };
+static unsigned timing_seed; /* per router, for rand_r */
 
 
 /* these static functions are defined by the dr */
@@ -86,7 +147,9 @@ static lvns_interface_t (*dr_get_interface)(unsigned index);
 /*** Sends specified dynamic routing payload.** @param dst_ip   The ultimate destination of the packet.
  ** @param next_hop_ip  The IP of the next hop (either a router or the final dst).** @param outgoing_intf  Index of the interface to send the packet from.
  ** @param payload  This will be sent as the payload of the DR packet.  The caller*                 is reponsible for managing the memory associated with buf*                 (e.g. this function will NOT free buf).
- ** @param len      The number of bytes in the DR payload.*/
+ ** @param len      The number of bytes in the DR payload.
+ * This queues the payload (see dr_sendq.h), so it is safe to call with
+ * coarse_lock held; the sender thread calls the DR's function.*/
 static void (*dr_send_payload)(uint32_t dst_ip,
                                uint32_t next_hop_ip,
                                uint32_t outgoing_intf,
@@ -101,11 +164,38 @@ void print_routing_table(route_t *head);
 /* internal lock-safe methods for the students to implement */
 struct timeval get_struct_timeval();
 void append(route_t *head, route_t *new_entry);
+static void update_route(route_t *current, route_t *new_entry);
 void remove(route_t *to_remove);
+static void remove_route(route_t *to_remove, int damp);
 uint32_t count_route_table_entries();
 void print_packet(rip_entry_t *packet);
 static next_hop_t safe_dr_get_next_hop(uint32_t ip);
+static next_hop_t safe_dr_get_next_hop_flow(uint32_t ip, uint32_t flow_hash);
+static void route_set_single_path(route_t *route, uint32_t next_hop_ip, uint32_t intf);
+static int route_has_path(route_t *route, uint32_t next_hop_ip);
+static int route_has_path_on_intf(route_t *route, uint32_t intf);
+static int route_add_path(route_t *route, uint32_t next_hop_ip, uint32_t intf);
+static uint32_t route_remove_path(route_t *route, uint32_t next_hop_ip);
+static uint32_t route_remove_paths_on_intf(route_t *route, uint32_t intf);
+static uint32_t mix_hash(uint32_t x);
+static void route_event(route_t *route, int type, dr_route_event_t *event);
+static void notify_route_change(route_t *route, int type);
 void advertise_routing_table();
+static void trace_routing_table();
+static void fill_rip_entry(rip_entry_t *packet, route_t *route);
+static void fill_intf_entry(rip_entry_t *packet, route_t *route, uint32_t intf);
+static void view_init(uint32_t num_interfaces);
+#ifdef DR_CONVERGENCE_TRACE
+static void trace_originate(route_t *route);
+static void trace_install(route_t *route, rip_entry_t *received);
+#endif
+static void view_update(route_t *route, int type);
+static void send_routing_table(uint32_t intf);
+static void send_rip_request(uint32_t intf);
+static void answer_rip_request(unsigned intf, rip_header_t *header,
+                               char* buf /* borrowed */, uint32_t num_entries);
+static void handle_rip_entry(uint32_t ip, unsigned intf, rip_entry_t *received);
+static void withdraw_paths_on_intf(uint32_t intf);
 void broadcast_single_entry(route_t *);
 void broadcast_intf_down(uint32_t );
 static void safe_dr_handle_packet(uint32_t ip, unsigned intf,
@@ -115,15 +205,42 @@ static void safe_dr_interface_changed(unsigned intf,
                                       int state_changed,
                                       int cost_changed);
 
+/* prints the send queue's counters, e.g. to compare peak rates across routers */
+static void dump_send_stats() {
+    dr_send_stats_t stats;
+
+    dr_get_send_stats(&stats);
+    fprintf(stderr, "send queue: %lu queued, %lu sent (peak %lu/s), %lu merged, %lu dropped\n",
+            (unsigned long)stats.queued, (unsigned long)stats.sent,
+            (unsigned long)stats.peak_per_sec, (unsigned long)stats.merged,
+            (unsigned long)stats.dropped);
+}
+
 /*** This simple method is the entry point to a thread which will periodically* make a callback to your dr_handle_periodic method.*/
 static void* periodic_callback_manager_main(void* nil) {
     struct timespec timeout;
+    unsigned sleep_ms;
+    unsigned ticks = 0;
 
-    timeout.tv_sec = secs_to_sleep_between_callbacks;
-    timeout.tv_nsec = nanosecs_to_sleep_between_callbacks;
+    /* start at a random phase so that routers started together drift apart */
+    sleep_ms = timing.max_phase_ms ? rand_r(&timing_seed) % (timing.max_phase_ms + 1) : 0;
     while(1) {
+        timeout.tv_sec = sleep_ms / 1000;
+        timeout.tv_nsec = (sleep_ms % 1000) * 1000000L;
         nanosleep(&timeout, NULL);
         dr_handle_periodic();
+
+        /* the next one comes interval_ms +- jitter_ms from now */
+        sleep_ms = timing.interval_ms;
+        if(timing.jitter_ms > 0) {
+            unsigned jitter = rand_r(&timing_seed) % (2 * timing.jitter_ms + 1);
+            sleep_ms = sleep_ms + jitter > timing.jitter_ms ? sleep_ms + jitter - timing.jitter_ms : 0;
+        }
+        if(++ticks % STATS_DUMP_TICKS == 0) {
+            dump_send_stats();
+            dr_dump_lock_profile();
+            dr_dump_convergence_trace();
+        }
     }
 
     return NULL;
@@ -137,8 +254,23 @@ next_hop_t dr_get_next_hop(uint32_t ip) {
     return hop;
 }
 
+next_hop_t dr_get_next_hop_flow(uint32_t ip, uint32_t flow_hash) {
+    next_hop_t hop;
+    rmutex_lock(&coarse_lock);
+    hop = safe_dr_get_next_hop_flow(ip, flow_hash);
+    rmutex_unlock(&coarse_lock);
+    return hop;
+}
+
 void dr_handle_packet(uint32_t ip, unsigned intf, char* buf /* borrowed */, unsigned len) {
+#ifdef DR_CONVERGENCE_TRACE
+    uint64_t arrival_ns = convtrace_now_ns(); /* waiting for the lock is part of the install delay */
+#endif
     rmutex_lock(&coarse_lock);
+#ifdef DR_CONVERGENCE_TRACE
+    packet_arrival_ns = arrival_ns;
+#endif
+    dr_trace_packet(ip, intf, buf, len);
     safe_dr_handle_packet(ip, intf, buf, len);
     rmutex_unlock(&coarse_lock);
 }
@@ -146,18 +278,91 @@ void dr_handle_packet(uint32_t ip, unsigned intf, char* buf /* borrowed */, unsi
 void dr_handle_periodic() {
     rmutex_lock(&coarse_lock);
     safe_dr_handle_periodic();
+    if(dr_trace_enabled()) trace_routing_table();
     rmutex_unlock(&coarse_lock);
 }
 
 void dr_interface_changed(unsigned intf, int state_changed, int cost_changed) {
     rmutex_lock(&coarse_lock);
+    dr_trace_interface_changed(intf, state_changed, cost_changed, dr_get_interface(intf));
     safe_dr_interface_changed(intf, state_changed, cost_changed);
     rmutex_unlock(&coarse_lock);
 }
 
+int dr_configure_timing(const dr_timing_config_t* config) {
+    if(config->interval_ms == 0 || config->jitter_ms >= config->interval_ms)
+        return -1; /* the periodic thread would spin */
+    timing = *config;
+    return 0;
+}
+
+void dr_get_send_stats(dr_send_stats_t* stats) {
+    sendq_get_stats(stats);
+}
+
+void dr_configure_damping(const dr_damping_config_t* config) {
+    rmutex_lock(&coarse_lock);
+    damping_configure(config);
+    rmutex_unlock(&coarse_lock);
+}
+
+void dr_dump_lock_profile() {
+    /* not under coarse_lock, it would show up in its own profile */
+    rmutex_profile_dump(&coarse_lock, stderr);
+}
+
+void dr_dump_convergence_trace() {
+#ifdef DR_CONVERGENCE_TRACE
+    rmutex_lock(&coarse_lock);
+    convtrace_dump(stderr);
+    rmutex_unlock(&coarse_lock);
+#endif
+}
+
 
 route_t *head_rt = NULL; //Head of the routing table
 
+int dr_register_route_listener(dr_route_listener_t listener, void* ctx) {
+    int ret = -1;
+    rmutex_lock(&coarse_lock);
+    if(num_route_listeners < MAX_ROUTE_LISTENERS) {
+        route_listeners[num_route_listeners] = listener;
+        route_listener_ctx[num_route_listeners] = ctx;
+        num_route_listeners++;
+        ret = 0;
+    }
+    rmutex_unlock(&coarse_lock);
+    return ret;
+}
+
+uint64_t dr_dump_table(uint64_t since_seq, dr_route_listener_t listener, void* ctx) {
+    dr_route_event_t event;
+    uint64_t seq;
+
+    rmutex_lock(&coarse_lock);
+    if(since_seq > 0 && since_seq < withdraw_log_floor) {
+        /* we no longer know everything which was withdrawn since */
+        memset(&event, 0, sizeof(event));
+        event.seq = route_seq;
+        event.type = DR_ROUTE_FLUSH;
+        listener(&event, ctx);
+        since_seq = 0;
+    }
+    for(unsigned i=0;i<WITHDRAW_LOG_SIZE;i++) {
+        dr_route_event_t *w = &withdraw_log[(withdraw_log_next + i) % WITHDRAW_LOG_SIZE];
+        if(w->seq > since_seq) listener(w, ctx);
+    }
+    for(route_t *current = head_rt; current != NULL; current = current->next) {
+        if(current->seq > since_seq) {
+            route_event(current, DR_ROUTE_ADD, &event);
+            listener(&event, ctx);
+        }
+    }
+    seq = route_seq;
+    rmutex_unlock(&coarse_lock);
+    return seq;
+}
+
 void dr_init(unsigned (*func_dr_interface_count)(),
              lvns_interface_t (*func_dr_get_interface)(unsigned index),
              void (*func_dr_send_payload)(uint32_t dst_ip,
@@ -170,14 +375,47 @@ void dr_init(unsigned (*func_dr_interface_count)(),
     /* save the functions the DR is providing for us */
     dr_interface_count = func_dr_interface_count;
     dr_get_interface = func_dr_get_interface;
-    dr_send_payload = func_dr_send_payload;
+    dr_send_payload = sendq_push;
+
+    /* payloads are sent from their own thread, outside of coarse_lock */
+    if(sendq_init(func_dr_send_payload, sizeof(rip_entry_t)) != 0) {
+        exit(1);
+    }
+
+    /* the periodic thread may tick right away (see dr_configure_timing), it
+     * must not see the table and the views while they are being built */
+    rmutex_lock(&coarse_lock);
+
+    /* the per-interface advertisements have to exist before the first route */
+    view_init(dr_interface_count());
+
+    /* record every call into the library if asked to (see dr_trace.h) */
+    if(getenv(DR_TRACE_ENV) != NULL) {
+        uint32_t num_interfaces = dr_interface_count();
+        dr_trace_intf_t interfaces[num_interfaces];
+        for(uint32_t i=0;i<num_interfaces;i++)
+            interfaces[i] = dr_trace_intf(dr_get_interface(i));
+        dr_trace_open(getenv(DR_TRACE_ENV), num_interfaces, interfaces);
+    }
 
-    /* initialize the recursive mutex */
-    rmutex_init(&coarse_lock);
+    /* let routers started by a host which does not configure them be tuned */
+    if(getenv(DR_TIMING_ENV) != NULL) {
+        dr_timing_config_t config;
+        if(sscanf(getenv(DR_TIMING_ENV), "%u,%u,%u", &config.interval_ms,
+                  &config.jitter_ms, &config.max_phase_ms) != 3
+           || dr_configure_timing(&config) != 0)
+            fprintf(stderr, "ignoring invalid %s=%s\n", DR_TIMING_ENV, getenv(DR_TIMING_ENV));
+    }
+
+    /* seed the timing jitter differently on every router */
+    timing_seed = getpid() ^ time(NULL) ^ (dr_interface_count() > 0 ? dr_get_interface(0).ip : 0);
 
-    /* initialize the amount of time we want between callbacks */
-    secs_to_sleep_between_callbacks = 1;
-    nanosecs_to_sleep_between_callbacks = 0;
+#ifdef DR_CONVERGENCE_TRACE
+    router_id = 0xFFFFFFFF;
+    for(uint32_t i=0;i<dr_interface_count();i++){
+      if(ntohl(dr_get_interface(i).ip) < ntohl(router_id)) router_id = dr_get_interface(i).ip;
+    }
+#endif
 
     /* start a new thread to provide the periodic callbacks */
     if(pthread_create(&tid, NULL, periodic_callback_manager_main, NULL) != 0) {
@@ -194,24 +432,37 @@ void dr_init(unsigned (*func_dr_interface_count)(),
       route_t *new_entry = (route_t *) malloc(sizeof(route_t)); //DEBUG:Add catch of false malloc
       new_entry->subnet = tmp.subnet_mask & tmp.ip; //Destination
       new_entry->mask = tmp.subnet_mask;
-      new_entry->next_hop_ip = 0; //NOTE: Not needed for initial, direct connections
-      new_entry->outgoing_intf = i;
+      route_set_single_path(new_entry, 0, i); //NOTE: next hop not needed for initial, direct connections
       new_entry->cost = tmp.cost;
       new_entry->last_updated = get_struct_timeval();
-      new_entry->learned_from = 0;
       new_entry->is_garbage = 0;
       new_entry->next = NULL;
+      TRACE_ORIGINATE(new_entry);
 
       if(i==0){
         head_rt = new_entry;
+        notify_route_change(new_entry, DR_ROUTE_ADD);
       } else{
         append(head_rt, new_entry);
       }
     }
     if(DEBUG) print_routing_table(head_rt);
+
+    /*Ask the neighbours for their tables instead of waiting for their next advertisement*/
+    for(uint32_t i=0;i<dr_interface_count();i++){
+      if(dr_get_interface(i).enabled){
+        send_rip_request(i);
+      }
+    }
+    rmutex_unlock(&coarse_lock);
 }
 
 next_hop_t safe_dr_get_next_hop(uint32_t ip) {
+    /* without flow information, spread destinations over the equal-cost paths */
+    return safe_dr_get_next_hop_flow(ip, mix_hash(ip));
+}
+
+next_hop_t safe_dr_get_next_hop_flow(uint32_t ip, uint32_t flow_hash) {
     next_hop_t hop;
 
     hop.interface = 0;
@@ -221,8 +472,19 @@ next_hop_t safe_dr_get_next_hop(uint32_t ip) {
     route_t *current = head_rt;
     while(current != NULL){
       if((ip & current->mask) == current->subnet/* && current->cost < 16*/){
-        hop.interface = current->outgoing_intf;
-        hop.dst_ip = current->next_hop_ip;
+        /*Rendezvous hashing: every path gets a score for this flow and the highest
+        wins. Adding or removing a path only moves the flows of that path.*/
+        uint32_t best = 0;
+        uint32_t best_score = 0;
+        for(uint32_t i=0;i<current->num_paths;i++){
+          uint32_t score = mix_hash(flow_hash ^ mix_hash(current->paths[i].next_hop_ip + current->paths[i].outgoing_intf));
+          if(i == 0 || score > best_score){
+            best = i;
+            best_score = score;
+          }
+        }
+        hop.interface = current->paths[best].outgoing_intf;
+        hop.dst_ip = current->paths[best].next_hop_ip;
         return hop; //There is only one entry to a certain IP/subnet
       }
       current = current->next;
@@ -235,13 +497,32 @@ next_hop_t safe_dr_get_next_hop(uint32_t ip) {
 void safe_dr_handle_packet(uint32_t ip, unsigned intf,
                            char* buf /* borrowed */, unsigned len) {
     /* handle the dynamic routing payload in the buf buffer */
-    //uint8_t offset = 0;
-    rip_entry_t *received = (rip_entry_t *) malloc(sizeof(rip_entry_t));
-    rip_header_t *header = (rip_header_t *) malloc(sizeof(rip_header_t));
+    rip_header_t header;
+    rip_entry_t received;
 
-    memcpy(header, buf, sizeof(rip_header_t));
-    memcpy(received, buf + sizeof(rip_header_t), sizeof(rip_entry_t));
+    if(len < sizeof(rip_header_t)){
+      return;
+    }
+    memcpy(&header, buf, sizeof(rip_header_t));
+    uint32_t num_entries = (len - sizeof(rip_header_t)) / sizeof(rip_entry_t);
 
+    if(header.command == RIP_COMMAND_REQUEST){
+      answer_rip_request(intf, &header, buf, num_entries);
+      return;
+    }
+    if(header.command != RIP_COMMAND_RESPONSE){
+      return;
+    }
+
+    /*A response may carry several entries, handle them one by one*/
+    for(uint32_t i=0;i<num_entries;i++){
+      memcpy(&received, buf + sizeof(rip_header_t) + i * sizeof(rip_entry_t), sizeof(rip_entry_t));
+      handle_rip_entry(ip, intf, &received);
+    }
+}
+
+/*Processes one route (u --> v) advertised by the neighbour u with IP ip*/
+void handle_rip_entry(uint32_t ip, unsigned intf, rip_entry_t *received) {
     bool here_u_exists = false;
     bool here_v_exists = false;
     bool v_same_as_here = false;
@@ -252,26 +533,24 @@ void safe_dr_handle_packet(uint32_t ip, unsigned intf,
     route_t *here_v;
 
 
-    for(uint32_t i=0;i<dr_interface_count();i++){
-      lvns_interface_t tmp = dr_get_interface(i);
-      if(received->learned_from == tmp.ip){
-        fprintf(stderr, "%s\n", "Omit route!"); //This route has been learned from this IP and is now being send here again -> omit (Split horizon w/ poison reverse)
-        received->metric = INFINITY;
-      }
-    }
-
-
     if(received->ip == received->next_hop){ /*The interface received->ip is down*/
       //fprintf(stderr, "%s ","Interface down with IP: ");
       //print_ip(received->ip);
       while(current != NULL){
-        if(current->next_hop_ip == received->ip || current->subnet == received->ip){
-          current->cost = INFINITY;
+        route_t *next = current->next;
+        if(current->subnet != received->ip && route_has_path(current, received->ip)
+           && route_remove_path(current, received->ip) > 0){
+          /*Another equal-cost path is left, keep the route*/
+          notify_route_change(current, DR_ROUTE_MODIFY);
+          print_routing_table(head_rt);
+        } else if(current->next_hop_ip == received->ip || current->subnet == received->ip){
+          TRACE_INSTALL(current, received);
+          current->is_garbage = 1; //Advertised as INFINITY; keeps the cost for the hold-down
           broadcast_single_entry(current);
           broadcast_intf_down(received->ip);
           remove(current);
         }
-        current = current->next;
+        current = next;
       }
       return;
     }
@@ -314,8 +593,18 @@ void safe_dr_handle_packet(uint32_t ip, unsigned intf,
         here_v = current;
         /*Check if the next hop is u (ip), if yes and the route is garbage
         we need to broadcast that, remove the entry and return*/
-        if(here_v->next_hop_ip == ip && received->metric > 15){
+        if(route_has_path(here_v, ip) && received->metric > 15){
+          if(here_v->num_paths > 1){
+            /*Only one of the equal-cost paths went bad, drop just that one*/
+            fprintf(stderr, "%s\n", "Dirty equal-cost path, removing it from the route");
+            route_remove_path(here_v, ip);
+            TRACE_INSTALL(here_v, received);
+            notify_route_change(here_v, DR_ROUTE_MODIFY);
+            print_routing_table(head_rt);
+            return;
+          }
           fprintf(stderr, "%s\n", "Using a dirty route! Broadcast and remove...");
+          TRACE_INSTALL(here_v, received);
           here_v->is_garbage = 1;
           broadcast_single_entry(here_v);
           remove(here_v);
@@ -328,19 +617,18 @@ void safe_dr_handle_packet(uint32_t ip, unsigned intf,
     if(!here_u_exists && !v_same_as_here){ //This connection doesn't exist, add
       here_u = (route_t *) malloc(sizeof(route_t));
       here_u->subnet = ip;
-      here_u->next_hop_ip = 0; //This is a direct connection
       for(uint32_t i=0;i<dr_interface_count();i++){
         lvns_interface_t tmp = dr_get_interface(i);
         if(((tmp.ip & tmp.subnet_mask) == (ip & tmp.subnet_mask)) && tmp.enabled){ //We received drX --> drHere
           u_interface_index = i;
           //we have found the correct interface
-          here_u->outgoing_intf = i;
+          route_set_single_path(here_u, 0, i); //This is a direct connection
           here_u->cost = tmp.cost;
           here_u->mask = tmp.subnet_mask;
           here_u->last_updated = get_struct_timeval();
-          here_u->learned_from = 0;
           here_u->is_garbage = 0;
           here_u->next = NULL;
+          TRACE_ORIGINATE(here_u);
           //Append to the list
           if(here_u->cost <= 15){
             append(head_rt, here_u);
@@ -354,46 +642,63 @@ void safe_dr_handle_packet(uint32_t ip, unsigned intf,
       }
     }
     if(!here_v_exists && !v_same_as_here && u_interface_index != -1){
-      here_v = (route_t *) malloc(sizeof(route_t));
+      here_v = (route_t *) calloc(1, sizeof(route_t)); //Zeroed, so it has no trace stamp yet
       here_v->subnet = received->ip; //received = u -> v
       here_v->mask = received->subnet_mask;
-      here_v->next_hop_ip = ip; //Hop to u first
-      here_v->outgoing_intf = u_interface_index; //Intf index to send out packets to u
+      route_set_single_path(here_v, ip, u_interface_index); //Hop to u first, over the intf leading to u
       here_v->cost = here_u->cost + received->metric;
       here_v->last_updated = get_struct_timeval();
-      here_v->learned_from = ip;
       here_v->is_garbage = 0;
       here_v->next = NULL;
-      if(here_v->cost <= 15){
+      if(here_v->cost <= 15 && damping_may_install(here_v->subnet, here_v->cost)){
+        TRACE_INSTALL(here_v, received);
         append(head_rt, here_v);
         broadcast_single_entry(here_v);
         here_v_exists = true;
         fprintf(stderr, "%s\n", "Added here -> v");
         print_routing_table(head_rt);
+      } else{
+        free(here_v); //Unreachable, flapping or held down
       }
     } else if(!v_same_as_here && u_interface_index != -1 && here_u_exists){ /*Bellman Ford update*/
-      if(here_v->cost > here_u->cost + received->metric){
+      uint32_t new_cost = here_u->cost + received->metric;
+      if(here_v->cost > new_cost){
         fprintf(stderr, "%s", "Bellman Ford update of route here -> ");
         print_ip(here_v->subnet);
         fprintf(stderr, "%d > %d + %d\n",here_v->cost, here_u->cost, received->metric );
-        here_v->cost = here_u->cost + received->metric;
-        here_v->outgoing_intf = u_interface_index;
-        here_v->next_hop_ip = here_u->subnet;
+        here_v->cost = new_cost;
+        route_set_single_path(here_v, here_u->subnet, u_interface_index);
         here_v->mask = here_u->mask;
-        here_v->learned_from = ip;
+        TRACE_INSTALL(here_v, received);
+        notify_route_change(here_v, DR_ROUTE_MODIFY);
         print_routing_table(head_rt);
         /*Triggered update: Send out this packet immediately*/
         broadcast_single_entry(here_v);
+      } else if(here_v->cost == new_cost && here_v->next_hop_ip != 0 && !route_has_path(here_v, ip)){
+        /*Equal-cost multipath: remember u as an additional next hop. The cost
+        does not change, so there is nothing to advertise.*/
+        if(route_add_path(here_v, ip, u_interface_index)){
+          TRACE_INSTALL(here_v, received);
+          notify_route_change(here_v, DR_ROUTE_MODIFY);
+          fprintf(stderr, "%s", "Equal-cost path added to route here -> ");
+          print_ip(here_v->subnet);
+          print_routing_table(head_rt);
+        }
+      } else if(here_v->num_paths > 1 && route_has_path(here_v, ip) && here_v->cost < new_cost){
+        /*u is no longer as good as the other paths, stop using it*/
+        route_remove_path(here_v, ip);
+        TRACE_INSTALL(here_v, received);
+        notify_route_change(here_v, DR_ROUTE_MODIFY);
+        print_routing_table(head_rt);
       }
     }
-    free(header);
-    free(received);
 }
 
 void safe_dr_handle_periodic() {
     /* handle periodic tasks for dynamic routing here */
     /*Send out the complete routing table to neighbors*/
     advertise_routing_table();
+    damping_periodic();
 
     long current_time;
     route_t *current = head_rt;
@@ -402,6 +707,7 @@ void safe_dr_handle_periodic() {
       long time_entry = current->last_updated.tv_sec * 1000 + current->last_updated.tv_usec / 1000;
       if((current_time - time_entry)/1000.f > RIP_TIMEOUT_SEC){ //Convert difference to seconds
         current->is_garbage = 1;
+        TRACE_ORIGINATE(current);
         fprintf(stderr, "%s", "Garbage IP: ");
         print_ip(current->subnet);
         broadcast_single_entry(current);
@@ -413,6 +719,29 @@ void safe_dr_handle_periodic() {
 
 }
 
+/*Drops every path leaving over intf. Routes which are still reachable over
+another equal-cost path are modified, the others broadcast as garbage and removed*/
+void withdraw_paths_on_intf(uint32_t intf){
+  route_t *current = head_rt;
+  while(current != NULL){
+    route_t *next = current->next;
+    uint32_t num_paths = current->num_paths;
+    if(current->next_hop_ip != 0 && num_paths > 1 &&
+       route_remove_paths_on_intf(current, intf) > 0){
+      if(current->num_paths < num_paths){
+        TRACE_ORIGINATE(current);
+        notify_route_change(current, DR_ROUTE_MODIFY);
+      }
+    } else if(current->outgoing_intf == intf){
+      TRACE_ORIGINATE(current);
+      current->is_garbage = 1;
+      broadcast_single_entry(current);
+      remove_route(current, 0);
+    }
+    current = next;
+  }
+}
+
 static void safe_dr_interface_changed(unsigned intf,
                                       int state_changed,
                                       int cost_changed) {
@@ -425,7 +754,6 @@ static void safe_dr_interface_changed(unsigned intf,
         for all entries in the RT that use this intfc, is_garbage = 1, broadcast, new cost + is_garbage = 0, broadcast direct link to subnet */
 
     lvns_interface_t tmp = dr_get_interface(intf);
-    route_t *current = head_rt;
     route_t *new_entry;
     if(state_changed){
       bool EN = (tmp.enabled != 0);
@@ -433,45 +761,32 @@ static void safe_dr_interface_changed(unsigned intf,
         new_entry = (route_t *) malloc(sizeof(route_t));
         new_entry->subnet = tmp.ip & tmp.subnet_mask;
         new_entry->mask = tmp.subnet_mask;
-        new_entry->next_hop_ip = 0;
-        new_entry->outgoing_intf = intf;
+        route_set_single_path(new_entry, 0, intf);
         new_entry->cost = tmp.cost;
         new_entry->last_updated = get_struct_timeval();
-        new_entry->learned_from = 0;
         new_entry->is_garbage = 0;
         new_entry->next = NULL;
+        TRACE_ORIGINATE(new_entry);
         append(head_rt, new_entry);
         broadcast_single_entry(new_entry);
+        /*Resync with the neighbour behind the link that just came back*/
+        send_rip_request(intf);
       } else{
         broadcast_intf_down(tmp.ip);
-        while(current->next != NULL){
-          if(current->outgoing_intf == intf){
-            current->cost = INFINITY;
-            broadcast_single_entry(current);
-            remove(current);
-          }
-          current = current->next;
-        }
+        withdraw_paths_on_intf(intf);
       }
     } else if(cost_changed){
-      while (current != NULL) {
-        if(current->outgoing_intf == intf){
-          current->is_garbage = 1;
-          broadcast_single_entry(current);
-          remove(current);
-        }
-        current = current->next;
-      }
+      /*Paths over intf are relearned at the new cost*/
+      withdraw_paths_on_intf(intf);
       new_entry = (route_t *) malloc(sizeof(route_t));
       new_entry->subnet = tmp.ip & tmp.subnet_mask;
       new_entry->mask = tmp.subnet_mask;
-      new_entry->next_hop_ip = 0;
-      new_entry->outgoing_intf = intf;
+      route_set_single_path(new_entry, 0, intf);
       new_entry->cost = tmp.cost;
       new_entry->last_updated = get_struct_timeval();
-      new_entry->learned_from = 0;
       new_entry->is_garbage = 0;
       new_entry->next = NULL;
+      TRACE_ORIGINATE(new_entry);
       append(head_rt, new_entry);
       broadcast_single_entry(new_entry);
     } else {
@@ -481,9 +796,122 @@ static void safe_dr_interface_changed(unsigned intf,
 
 /* definition of internal functions */
 
+/*Makes next_hop_ip (over intf) the one and only path of the route*/
+void route_set_single_path(route_t *route, uint32_t next_hop_ip, uint32_t intf){
+  route->next_hop_ip = next_hop_ip;
+  route->outgoing_intf = intf;
+  route->paths[0].next_hop_ip = next_hop_ip;
+  route->paths[0].outgoing_intf = intf;
+  route->num_paths = 1;
+}
+
+int route_has_path(route_t *route, uint32_t next_hop_ip){
+  for(uint32_t i=0;i<route->num_paths;i++){
+    if(route->paths[i].next_hop_ip == next_hop_ip) return 1;
+  }
+  return 0;
+}
+
+/*Whether one of the paths of a learned route leaves over intf, split horizon
+poisons the route there*/
+int route_has_path_on_intf(route_t *route, uint32_t intf){
+  if(route->next_hop_ip == 0){
+    return 0; //Directly connected
+  }
+  for(uint32_t i=0;i<route->num_paths;i++){
+    if(route->paths[i].outgoing_intf == intf) return 1;
+  }
+  return 0;
+}
+
+/*Adds an equal-cost path, returns 0 if it is already known or the route is full*/
+int route_add_path(route_t *route, uint32_t next_hop_ip, uint32_t intf){
+  if(route_has_path(route, next_hop_ip) || route->num_paths >= RIP_MAX_ECMP_PATHS){
+    return 0;
+  }
+  route->paths[route->num_paths].next_hop_ip = next_hop_ip;
+  route->paths[route->num_paths].outgoing_intf = intf;
+  route->num_paths++;
+  return 1;
+}
+
+/*Removes the path over next_hop_ip and returns the number of paths left.
+The primary next hop always mirrors paths[0].*/
+uint32_t route_remove_path(route_t *route, uint32_t next_hop_ip){
+  for(uint32_t i=0;i<route->num_paths;i++){
+    if(route->paths[i].next_hop_ip == next_hop_ip){
+      route->paths[i] = route->paths[route->num_paths - 1];
+      route->num_paths--;
+      break;
+    }
+  }
+  if(route->num_paths > 0){
+    route->next_hop_ip = route->paths[0].next_hop_ip;
+    route->outgoing_intf = route->paths[0].outgoing_intf;
+  }
+  return route->num_paths;
+}
+
+/*Removes all paths leaving over intf and returns the number of paths left*/
+uint32_t route_remove_paths_on_intf(route_t *route, uint32_t intf){
+  uint32_t i = 0;
+  while(i < route->num_paths){
+    if(route->paths[i].outgoing_intf == intf){
+      route_remove_path(route, route->paths[i].next_hop_ip);
+    } else i++;
+  }
+  return route->num_paths;
+}
+
+/*Describes the current state of route as an event of the given type*/
+void route_event(route_t *route, int type, dr_route_event_t *event){
+  memset(event, 0, sizeof(*event));
+  event->seq = route->seq;
+  event->type = type;
+  event->subnet = route->subnet;
+  event->mask = route->mask;
+  event->cost = route->cost;
+  if(type != DR_ROUTE_WITHDRAW){
+    event->num_next_hops = route->num_paths;
+    for(uint32_t i=0;i<route->num_paths;i++){
+      event->next_hops[i].interface = route->paths[i].outgoing_intf;
+      event->next_hops[i].dst_ip = route->paths[i].next_hop_ip;
+    }
+  }
+}
+
+/*Gives the change a sequence number and tells all listeners about it*/
+void notify_route_change(route_t *route, int type){
+  dr_route_event_t event;
+  route->seq = ++route_seq;
+  route_event(route, type, &event);
+  view_update(route, type);
+
+  if(type == DR_ROUTE_WITHDRAW){
+    dr_route_event_t *slot = &withdraw_log[withdraw_log_next];
+    if(slot->seq > withdraw_log_floor) withdraw_log_floor = slot->seq;
+    *slot = event;
+    withdraw_log_next = (withdraw_log_next + 1) % WITHDRAW_LOG_SIZE;
+  }
+  for(unsigned i=0;i<num_route_listeners;i++){
+    route_listeners[i](&event, route_listener_ctx[i]);
+  }
+}
+
+// integer finalizer of MurmurHash3, used to pick among equal-cost paths
+uint32_t mix_hash(uint32_t x){
+  x ^= x >> 16;
+  x *= 0x85ebca6b;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35;
+  x ^= x >> 16;
+  return x;
+}
+
 void broadcast_intf_down(uint32_t intf_ip){
   rip_entry_t *packet = (rip_entry_t *) malloc(sizeof(rip_entry_t));
   rip_header_t *header = (rip_header_t *) malloc(sizeof(rip_header_t));
+  memset(packet, 0, sizeof(*packet));
   packet->addr_family = IPV4_ADDR_FAM;
   packet->pad = 0;
   packet->ip = intf_ip;
@@ -507,17 +935,7 @@ void broadcast_single_entry(route_t *to_broadcast){
       if(dr_get_interface(i).enabled){
       rip_entry_t *packet = (rip_entry_t *) malloc(sizeof(rip_entry_t));
       rip_header_t *header = (rip_header_t *) malloc(sizeof(rip_header_t));
-      packet->addr_family = IPV4_ADDR_FAM;
-      packet->pad = 0;
-      packet->ip = to_broadcast->subnet;
-      packet->subnet_mask = to_broadcast->mask;
-      packet->next_hop = to_broadcast->next_hop_ip;
-      packet->learned_from = to_broadcast->learned_from;
-      if(to_broadcast->is_garbage == 1){
-        packet->metric = INFINITY;
-      } else{
-        packet->metric = to_broadcast->cost;
-      }
+      fill_intf_entry(packet, to_broadcast, i);
       header->command = RIP_COMMAND_RESPONSE;
       header->version = RIP_VERSION;
       header->pad = 0;
@@ -532,45 +950,196 @@ void broadcast_single_entry(route_t *to_broadcast){
 }
 
 void advertise_routing_table(){
-  route_t *current;
   for(uint32_t i=0;i<dr_interface_count();i++){
     if(dr_get_interface(i).enabled){
-      current = head_rt;
-      while(current != NULL){
-        rip_entry_t *packet = (rip_entry_t *) malloc(sizeof(rip_entry_t));
-        rip_header_t *header = (rip_header_t *) malloc(sizeof(rip_header_t));
-        packet->addr_family = IPV4_ADDR_FAM;
-        packet->pad = 0;
-        packet->ip = current->subnet;
-        packet->subnet_mask = current->mask;
-        packet->next_hop = current->next_hop_ip;
-        packet->learned_from = current->learned_from;
-        if(current->is_garbage == 1){
-          packet->metric = INFINITY;
-        } else{
-          packet->metric = current->cost;
-        }
-        header->command = RIP_COMMAND_RESPONSE;
-        header->version = RIP_VERSION;
-        header->pad = 0;
+      send_routing_table(i);
+    } else{
+      broadcast_intf_down(dr_get_interface(i).ip);
+    }
+  }
+}
 
-        char buf[sizeof(*header) + sizeof(*packet)];
-        memcpy(buf, header, sizeof(*header));
-        memcpy(buf + sizeof(*header), packet, sizeof(*packet));
+void fill_rip_entry(rip_entry_t *packet, route_t *route){
+  packet->addr_family = IPV4_ADDR_FAM;
+  packet->pad = 0;
+  packet->ip = route->subnet;
+  packet->subnet_mask = route->mask;
+  packet->next_hop = route->next_hop_ip;
+  if(route->is_garbage == 1){
+    packet->metric = INFINITY;
+  } else{
+    packet->metric = route->cost;
+  }
+#ifdef DR_CONVERGENCE_TRACE
+  packet->pad = route->hops;
+  packet->origin_id = route->origin_id;
+  packet->origin_ns = route->origin_ns;
+#endif
+}
 
-        dr_send_payload(RIP_IP, RIP_IP, i,buf,sizeof(buf));
+/*Like fill_rip_entry, but as advertised out of intf: split horizon with poisoned
+reverse, a learned route is sent back with metric INFINITY on every interface it
+is reached through*/
+void fill_intf_entry(rip_entry_t *packet, route_t *route, uint32_t intf){
+  fill_rip_entry(packet, route);
+  if(route_has_path_on_intf(route, intf)){
+    packet->metric = INFINITY;
+  }
+}
 
-        free(packet);
-        free(header);
+#ifdef DR_CONVERGENCE_TRACE
+/*The change to route starts here*/
+void trace_originate(route_t *route){
+  route->origin_id = router_id;
+  route->origin_ns = convtrace_now_ns();
+  route->hops = 0;
+}
 
-        current = current->next;
+/*The change to route was caused by received, remember where it came from and
+how long it took to get here and into the table. A stamp which is not newer
+than the route's own, e.g. repeated by a periodic advertisement or an answer
+to a request long after the change, would only inflate the delays.*/
+void trace_install(route_t *route, rip_entry_t *received){
+  if(received->origin_ns <= route->origin_ns){
+    return;
+  }
+  route->origin_id = received->origin_id;
+  route->origin_ns = received->origin_ns;
+  route->hops = received->pad + 1;
+  convtrace_record(route->hops, route->origin_ns, packet_arrival_ns, convtrace_now_ns());
+}
+#endif
+
+void view_init(uint32_t num_interfaces){
+  num_intf_views = num_interfaces;
+  intf_views = (rip_entry_t **) calloc(num_interfaces + 1, sizeof(rip_entry_t *));
+}
+
+/*Keeps the interface views in line with a change of route*/
+void view_update(route_t *route, int type){
+  if(type == DR_ROUTE_ADD){
+    if(num_view_routes == max_view_routes){
+      max_view_routes = max_view_routes ? 2 * max_view_routes : 16;
+      view_routes = (route_t **) realloc(view_routes, max_view_routes * sizeof(route_t *));
+      for(uint32_t i=0;i<num_intf_views;i++){
+        intf_views[i] = (rip_entry_t *) realloc(intf_views[i], max_view_routes * sizeof(rip_entry_t));
       }
-    } else{
-      broadcast_intf_down(dr_get_interface(i).ip);
     }
+    route->view_slot = num_view_routes++;
+    view_routes[route->view_slot] = route;
+  } else if(route->view_slot >= num_view_routes || view_routes[route->view_slot] != route){
+    return; //Not advertised (any more)
+  }
+
+  uint32_t slot = route->view_slot;
+  if(type == DR_ROUTE_WITHDRAW){
+    /*Fill the hole with the last slot*/
+    uint32_t last = --num_view_routes;
+    view_routes[slot] = view_routes[last];
+    view_routes[slot]->view_slot = slot;
+    for(uint32_t i=0;i<num_intf_views;i++){
+      intf_views[i][slot] = intf_views[i][last];
+    }
+    return;
+  }
+  for(uint32_t i=0;i<num_intf_views;i++){
+    fill_intf_entry(&intf_views[i][slot], route, i);
+  }
+}
+
+/*Sends the whole routing table out of intf, RIP_MAX_ENTRIES routes per packet.
+The entries come straight from the view of intf.*/
+void send_routing_table(uint32_t intf){
+  char buf[sizeof(rip_header_t) + RIP_MAX_ENTRIES * sizeof(rip_entry_t)];
+  rip_header_t *header = (rip_header_t *) buf;
+  header->command = RIP_COMMAND_RESPONSE;
+  header->version = RIP_VERSION;
+  header->pad = 0;
+
+  if(intf >= num_intf_views){
+    return;
+  }
+  for(uint32_t first=0;first<num_view_routes;first+=RIP_MAX_ENTRIES){
+    uint32_t num_entries = num_view_routes - first;
+    if(num_entries > RIP_MAX_ENTRIES){
+      num_entries = RIP_MAX_ENTRIES;
+    }
+    memcpy(buf + sizeof(rip_header_t), &intf_views[intf][first], num_entries * sizeof(rip_entry_t));
+    dr_send_payload(RIP_IP, RIP_IP, intf, buf, sizeof(rip_header_t) + num_entries * sizeof(rip_entry_t));
   }
 }
 
+/*Asks the neighbours on intf for their whole routing table (RFC 2453 3.9.1)*/
+void send_rip_request(uint32_t intf){
+  char buf[sizeof(rip_header_t) + sizeof(rip_entry_t)];
+  rip_header_t *header = (rip_header_t *) buf;
+  rip_entry_t packet;
+  header->command = RIP_COMMAND_REQUEST;
+  header->version = RIP_VERSION;
+  header->pad = 0;
+  memset(&packet, 0, sizeof(packet));
+  packet.addr_family = ADDR_FAM_UNSPEC;
+  packet.metric = INFINITY;
+  memcpy(buf + sizeof(rip_header_t), &packet, sizeof(packet));
+  dr_send_payload(RIP_IP, RIP_IP, intf, buf, sizeof(buf));
+}
+
+/*Answers a request right away, and only on the interface it came in on.
+A single entry with family 0 and metric 16 asks for the whole table, otherwise
+the requested entries are sent back with our metric for them filled in.*/
+void answer_rip_request(unsigned intf, rip_header_t *header,
+                        char* buf /* borrowed */, uint32_t num_entries){
+  if(num_entries == 0 || !dr_get_interface(intf).enabled){
+    return;
+  }
+  rip_entry_t *first = (rip_entry_t *) (buf + sizeof(rip_header_t));
+  if(num_entries == 1 && first->addr_family == ADDR_FAM_UNSPEC && first->metric == INFINITY){
+    if(DEBUG) fprintf(stderr, "%s\n", "Answering a full table request");
+    send_routing_table(intf);
+    return;
+  }
+
+  if(num_entries > RIP_MAX_ENTRIES){
+    num_entries = RIP_MAX_ENTRIES;
+  }
+  char reply[sizeof(rip_header_t) + RIP_MAX_ENTRIES * sizeof(rip_entry_t)];
+  memcpy(reply, header, sizeof(rip_header_t));
+  ((rip_header_t *) reply)->command = RIP_COMMAND_RESPONSE;
+  for(uint32_t i=0;i<num_entries;i++){
+    rip_entry_t packet;
+    memcpy(&packet, buf + sizeof(rip_header_t) + i * sizeof(rip_entry_t), sizeof(packet));
+    packet.metric = INFINITY;
+    route_t *current = head_rt;
+    while(current != NULL){
+      if(current->subnet == packet.ip){
+        fill_intf_entry(&packet, current, intf);
+        break;
+      }
+      current = current->next;
+    }
+    memcpy(reply + sizeof(rip_header_t) + i * sizeof(rip_entry_t), &packet, sizeof(packet));
+  }
+  dr_send_payload(RIP_IP, RIP_IP, intf, reply, sizeof(rip_header_t) + num_entries * sizeof(rip_entry_t));
+}
+
+/*Writes the table as the forwarding side sees it (through dr_get_next_hop) to the trace*/
+void trace_routing_table(){
+  uint32_t num_routes = 0;
+  route_t *current;
+  for(current = head_rt; current != NULL; current = current->next) num_routes++;
+
+  dr_trace_route_t *routes = (dr_trace_route_t *) malloc((num_routes + 1) * sizeof(dr_trace_route_t));
+  uint32_t i = 0;
+  for(current = head_rt; current != NULL; current = current->next, i++){
+    routes[i].subnet = current->subnet;
+    routes[i].mask = current->mask;
+    routes[i].cost = current->cost;
+    routes[i].hop = safe_dr_get_next_hop(current->subnet);
+  }
+  dr_trace_table(routes, num_routes);
+  free(routes);
+}
+
 // gives current time in milliseconds
 long get_time(){
     // Now in milliseconds
@@ -584,33 +1153,53 @@ void append(route_t *head, route_t *new_entry){
 
   while (current->next != NULL) {
     if(current->subnet == new_entry->subnet){
-      current->mask = new_entry->mask;
-      current->next_hop_ip = new_entry->next_hop_ip;
-      current->outgoing_intf = new_entry->outgoing_intf;
-      current->cost = new_entry->cost;
-      current->last_updated = new_entry->last_updated;
-      current->learned_from = new_entry->learned_from;
-      current->is_garbage = new_entry->is_garbage;
+      update_route(current, new_entry);
       return;
     }
     current = current->next;
   }
   if(current->subnet == new_entry->subnet){
-    current->mask = new_entry->mask;
-    current->next_hop_ip = new_entry->next_hop_ip;
-    current->outgoing_intf = new_entry->outgoing_intf;
-    current->cost = new_entry->cost;
-    current->last_updated = new_entry->last_updated;
-    current->learned_from = new_entry->learned_from;
-    current->is_garbage = new_entry->is_garbage;
+    update_route(current, new_entry);
     return;
   }
   current->next = (route_t *) malloc(sizeof(route_t)); //DEBUG:Add catch of false malloc
   current->next = new_entry;
+  notify_route_change(new_entry, DR_ROUTE_ADD);
+}
+
+/*Overwrites current with new_entry, listeners only hear about actual changes*/
+void update_route(route_t *current, route_t *new_entry){
+  bool changed = current->mask != new_entry->mask || current->cost != new_entry->cost
+                 || current->num_paths != new_entry->num_paths
+                 || memcmp(current->paths, new_entry->paths, new_entry->num_paths * sizeof(path_t)) != 0;
+  current->mask = new_entry->mask;
+  current->next_hop_ip = new_entry->next_hop_ip;
+  current->outgoing_intf = new_entry->outgoing_intf;
+  current->cost = new_entry->cost;
+  current->last_updated = new_entry->last_updated;
+  current->is_garbage = new_entry->is_garbage;
+  memcpy(current->paths, new_entry->paths, sizeof(current->paths));
+  current->num_paths = new_entry->num_paths;
+#ifdef DR_CONVERGENCE_TRACE
+  current->origin_id = new_entry->origin_id;
+  current->origin_ns = new_entry->origin_ns;
+  current->hops = new_entry->hops;
+#endif
+  if(changed) notify_route_change(current, DR_ROUTE_MODIFY);
 }
 
 void remove(route_t *to_remove){
+  remove_route(to_remove, 1);
+}
+
+/*Removes the route, damp is 0 if it went away with one of our own interfaces:
+that is no flap, and the route has to come back as soon as the link does*/
+void remove_route(route_t *to_remove, int damp){
   route_t *current = head_rt;
+  notify_route_change(to_remove, DR_ROUTE_WITHDRAW);
+  if(damp && to_remove->next_hop_ip != 0){ //Only learned routes are damped
+    damping_withdrawn(to_remove->subnet, to_remove->cost);
+  }
   if(to_remove == head_rt){
     if(head_rt->next != NULL){
       head_rt = head_rt->next;
@@ -681,6 +1270,10 @@ void print_routing_table(route_t *head){
         printf("\tOutgoing interface: ");
         print_ip(current->outgoing_intf);
         printf("\tCost: %d\n", current->cost);
+        for(uint32_t i=1;i<current->num_paths;i++){
+            printf("\tEqual-cost next hop ip: ");
+            print_ip(current->paths[i].next_hop_ip);
+        }
         printf("\tLast updated (timestamp in microseconds): %li \n", current->last_updated.tv_usec);
         printf("==============================\n");
         counter ++;
@@ -13,16 +13,86 @@
 
 #include "lvns_types.h"
 
+/** the most equal-cost next hops a route can have */
+#define DR_MAX_NEXT_HOPS 4
+
+/* kinds of routing table changes */
+#define DR_ROUTE_ADD      1 /* a new destination is reachable              */
+#define DR_ROUTE_MODIFY   2 /* the cost or next hops of a route changed     */
+#define DR_ROUTE_WITHDRAW 3 /* the destination is no longer reachable       */
+#define DR_ROUTE_FLUSH    4 /* only from dr_dump_table: forget all routes   */
+
+/** a change to the routing table */
+typedef struct dr_route_event_t {
+    uint64_t seq;           /* increases by one with every change */
+    int type;               /* DR_ROUTE_* */
+    uint32_t subnet;        /* network-byte order, like the rest of the API */
+    uint32_t mask;
+    uint32_t cost;
+    uint32_t num_next_hops; /* 0 for DR_ROUTE_WITHDRAW and DR_ROUTE_FLUSH */
+    next_hop_t next_hops[DR_MAX_NEXT_HOPS];
+} dr_route_event_t;
+
+/** receives routing table changes; ctx is the pointer given at registration */
+typedef void (*dr_route_listener_t)(const dr_route_event_t* event, void* ctx);
+
+/** counters of the outbound payload queue */
+typedef struct dr_send_stats_t {
+    uint64_t queued;  /* payloads handed to the queue                    */
+    uint64_t sent;    /* calls to the DR's send function                 */
+    uint64_t merged;  /* payloads merged into another one before sending */
+    uint64_t dropped; /* payloads lost because the queue was full        */
+    uint64_t peak_per_sec; /* most calls to the send function in one second */
+} dr_send_stats_t;
+
+/** when the periodic callback (and with it the advertisement) runs */
+typedef struct dr_timing_config_t {
+    unsigned interval_ms;  /* average time between periodic callbacks       */
+    unsigned jitter_ms;    /* each interval is randomly off by up to this   */
+    unsigned max_phase_ms; /* the first callback comes after a random delay
+                              of up to this, so routers started together
+                              do not advertise in lockstep                  */
+} dr_timing_config_t;
+
+/** route flap damping and hold-down parameters */
+typedef struct dr_damping_config_t {
+    unsigned penalty_per_flap; /* added on every withdrawal; 0 disables damping */
+    unsigned suppress_limit;   /* above this penalty the route is not used     */
+    unsigned reuse_limit;      /* ... until the penalty decays below this      */
+    unsigned half_life_sec;    /* time for the penalty to decay by half        */
+    unsigned max_penalty;      /* upper bound on the penalty                   */
+    unsigned holddown_sec;     /* after a withdrawal, only accept strictly
+                                  better routes for this long; 0 disables it   */
+} dr_damping_config_t;
+
+/**
+ * environment variable which overrides the timing at dr_init, for hosts which
+ * do not call dr_configure_timing: "INTERVAL_MS,JITTER_MS,MAX_PHASE_MS"
+ */
+#define DR_TIMING_ENV "DR_TIMING"
+
 /**
- * This function will be called before any other method here.  It may only be
- * called once.  The function pointer passed as an argument tells the DR API how
- * it can send packets.
+ * Sets the timing of the periodic callbacks.  Must be called before dr_init to
+ * have an effect; the default is a 1000 ms interval with 250 ms jitter and a
+ * phase offset of up to 1000 ms.  Returns 0 on success, or -1 (and keeps the
+ * timing as it was) unless 0 <= jitter_ms < interval_ms.
+ */
+int dr_configure_timing(const dr_timing_config_t* config);
+
+/**
+ * This function will be called before any other method here (except for
+ * dr_configure_timing, dr_configure_damping, dr_damping_defaults and
+ * dr_register_route_listener).  It may only be called once.  The function
+ * pointer passed as an argument tells the DR API how it can send packets.
  *     dst_ip         The ultimate desination of the packet.
  *     next_hop_ip    Next hop IP address (either a router or the ultimate dest)
  *     outgoing_intf  Index of the interface to send this packet out of
  *
  * This method initializes any data structures used internally by this library.
  * It may also start a thread to take care of periodic tasks.
+ *
+ * func_dr_send_payload is only ever called from a sending thread started here,
+ * never from within the other methods of this API.
  */
 void dr_init(unsigned (*func_dr_interface_count)(),
              lvns_interface_t (*func_dr_get_interface)(unsigned index),
@@ -41,6 +111,39 @@ void dr_init(unsigned (*func_dr_interface_count)(),
  */
 next_hop_t dr_get_next_hop(uint32_t ip);
 
+/**
+ * Registers a function which is called with every change to the routing table,
+ * e.g. to keep a forwarding table in sync without polling dr_get_next_hop.
+ * Listeners registered before dr_init also see the directly connected routes
+ * being added.  At most 4 listeners can be registered; returns 0 on success.
+ *
+ * The listener runs while the library's lock is held: it may call back into
+ * this API, but should not block.
+ */
+int dr_register_route_listener(dr_route_listener_t listener, void* ctx);
+
+/**
+ * Calls listener for the changes after since_seq: a DR_ROUTE_WITHDRAW for
+ * every route withdrawn since, then a DR_ROUTE_ADD with the current state of
+ * every route added or changed since.  Use since_seq 0 for the whole table.
+ * If withdrawals that old are no longer remembered, a DR_ROUTE_FLUSH is sent
+ * first and the whole table follows.
+ *
+ * Returns the sequence number of the latest change, to be passed in next time.
+ */
+uint64_t dr_dump_table(uint64_t since_seq, dr_route_listener_t listener, void* ctx);
+
+/**
+ * Like dr_get_next_hop, but picks among the equal-cost next hops of the route
+ * based on flow_hash (e.g. a hash of the packet's 5-tuple).  Packets of the
+ * same flow always take the same path, and adding or removing a path only
+ * moves the flows which used that path.
+ *
+ * If and only if a next hop cannot be determined, then the dst_ip field of the
+ * returned next_hop_t object will be 0xFFFFFFFF.
+ */
+next_hop_t dr_get_next_hop_flow(uint32_t ip, uint32_t flow_hash);
+
 /**
  * Handles the payload of a dynamic routing packet (e.g. a RIP or OSPF payload).
  *
@@ -73,4 +176,29 @@ void dr_handle_periodic();
  */
 void dr_interface_changed(unsigned intf, int state_changed, int cost_changed);
 
+/** Copies the counters of the outbound payload queue to stats. */
+void dr_get_send_stats(dr_send_stats_t* stats);
+
+/**
+ * Sets the route flap damping and hold-down parameters.  May be called before
+ * or after dr_init; until then, dr_damping_defaults() is used.
+ */
+void dr_configure_damping(const dr_damping_config_t* config);
+
+/** Returns the default damping parameters, e.g. to change just one of them. */
+dr_damping_config_t dr_damping_defaults();
+
+/**
+ * Prints how often and how long each of the methods above waited for and held
+ * the library's lock.  Does nothing unless built with RMUTEX_PROFILE=1.
+ */
+void dr_dump_lock_profile();
+
+/**
+ * Prints, per number of hops from the router where a route change originated,
+ * how long changes took to arrive here and to be installed.  Does nothing
+ * unless built with DR_CONVERGENCE_TRACE=1 (see dr_convtrace.h).
+ */
+void dr_dump_convergence_trace();
+
 #endif /* _DR_API_H_ */
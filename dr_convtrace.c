@@ -0,0 +1,77 @@
+/* Filename: dr_convtrace.c */
+
+#ifdef DR_CONVERGENCE_TRACE
+
+#include <time.h>
+
+#include "dr_convtrace.h"
+#include "log2hist.h"
+
+/** delays seen for changes which originated a given number of hops away */
+typedef struct convtrace_hist_t {
+    uint64_t count;
+    uint64_t arrival_ns_total;  /* origin -> packet handed to us  */
+    uint64_t arrival_ns_max;
+    uint64_t install_ns_total;  /* packet handed to us -> in table */
+    uint64_t install_ns_max;
+    uint64_t arrival[CONVTRACE_BUCKETS];
+    uint64_t install[CONVTRACE_BUCKETS];
+} convtrace_hist_t;
+
+/* index 0 is unused: installed routes are at least one hop from their origin;
+ * the DR API's lock protects these */
+static convtrace_hist_t hists[CONVTRACE_MAX_HOPS + 1];
+
+uint64_t convtrace_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void convtrace_record(unsigned hops, uint64_t origin_ns, uint64_t arrival_ns,
+                      uint64_t installed_ns) {
+    convtrace_hist_t* h;
+    uint64_t arrival, install;
+
+    if(origin_ns == 0)
+        return; /* from a router which does not know where the change came from */
+    if(hops > CONVTRACE_MAX_HOPS)
+        hops = CONVTRACE_MAX_HOPS;
+    h = &hists[hops];
+
+    /* clamp, in case the sender's clock is not ours after all */
+    arrival = arrival_ns > origin_ns ? arrival_ns - origin_ns : 0;
+    install = installed_ns > arrival_ns ? installed_ns - arrival_ns : 0;
+
+    h->count += 1;
+    h->arrival_ns_total += arrival;
+    if(arrival > h->arrival_ns_max)
+        h->arrival_ns_max = arrival;
+    h->install_ns_total += install;
+    if(install > h->install_ns_max)
+        h->install_ns_max = install;
+    h->arrival[log2hist_bucket(arrival, CONVTRACE_BUCKETS)] += 1;
+    h->install[log2hist_bucket(install, CONVTRACE_BUCKETS)] += 1;
+}
+
+void convtrace_dump(FILE* out) {
+    unsigned hops;
+
+    fprintf(out, "convergence trace:\n");
+    for(hops = 1; hops <= CONVTRACE_MAX_HOPS; hops++) {
+        convtrace_hist_t* h = &hists[hops];
+        if(h->count == 0)
+            continue;
+
+        fprintf(out, "  %u hop(s): %lu changes, arrival avg %lu us max %lu us, "
+                "install avg %lu us max %lu us\n", hops, (unsigned long)h->count,
+                (unsigned long)(h->arrival_ns_total / h->count / 1000),
+                (unsigned long)(h->arrival_ns_max / 1000),
+                (unsigned long)(h->install_ns_total / h->count / 1000),
+                (unsigned long)(h->install_ns_max / 1000));
+        log2hist_dump(out, "arrival", h->arrival, CONVTRACE_BUCKETS);
+        log2hist_dump(out, "install", h->install, CONVTRACE_BUCKETS);
+    }
+}
+
+#endif /* DR_CONVERGENCE_TRACE */
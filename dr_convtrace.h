@@ -0,0 +1,42 @@
+/*
+ * Filename: dr_convtrace.h
+ * Purpose:  Convergence tracing: how long route changes take to travel from
+ *           the router where they originate to the routers N hops away.
+ *
+ * Only compiled in with DR_CONVERGENCE_TRACE defined (make
+ * DR_CONVERGENCE_TRACE=1).  Every RIP entry then carries the ID of the router
+ * where the change originated, the CLOCK_MONOTONIC time it did so and the
+ * number of hops it has travelled.  The timestamps are only comparable between
+ * routers on the same host, which is how LVNS topologies are usually run.  All
+ * routers of a topology must be built the same way, as the entries get longer.
+ */
+
+#ifndef _DR_CONVTRACE_H_
+#define _DR_CONVTRACE_H_
+
+#ifdef DR_CONVERGENCE_TRACE
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif
+#include <stdio.h>
+
+#define CONVTRACE_MAX_HOPS 16 /* RIP's INFINITY */
+#define CONVTRACE_BUCKETS  28 /* bucket i counts [2^(i-1), 2^i) usecs */
+
+/** Returns the current CLOCK_MONOTONIC time in nanoseconds. */
+uint64_t convtrace_now_ns();
+
+/**
+ * Records that a change which originated origin_ns and travelled hops hops was
+ * received arrival_ns and installed into the routing table installed_ns.
+ */
+void convtrace_record(unsigned hops, uint64_t origin_ns, uint64_t arrival_ns,
+                      uint64_t installed_ns);
+
+/** Writes the arrival and install delay histograms per hop count to out. */
+void convtrace_dump(FILE* out);
+
+#endif /* DR_CONVERGENCE_TRACE */
+
+#endif /* _DR_CONVTRACE_H_ */
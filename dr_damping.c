@@ -0,0 +1,135 @@
+/* Filename: dr_damping.c */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "dr_damping.h"
+
+/** damping state of one destination */
+typedef struct damp_t {
+    uint32_t subnet;
+    double penalty;          /* as of last_decay_ms */
+    long last_decay_ms;
+    int suppressed;          /* boolean */
+    long holddown_until_ms;
+    uint32_t withdrawn_cost; /* cost of the route when it was last withdrawn */
+
+    struct damp_t* next;
+} damp_t;
+
+/* a route flapping more than twice within a half-life gets suppressed */
+static const dr_damping_config_t default_config = {
+    1000, /* penalty_per_flap */
+    2000, /* suppress_limit   */
+    750,  /* reuse_limit      */
+    30,   /* half_life_sec    */
+    6000, /* max_penalty      */
+    5     /* holddown_sec     */
+};
+
+static dr_damping_config_t config = default_config;
+static damp_t* head_damp = NULL;
+
+dr_damping_config_t dr_damping_defaults() {
+    return default_config;
+}
+
+static long damping_now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static damp_t* damping_find(uint32_t subnet) {
+    damp_t* current = head_damp;
+    while(current != NULL) {
+        if(current->subnet == subnet)
+            return current;
+        current = current->next;
+    }
+    return NULL;
+}
+
+/* brings the penalty up to date and lifts the suppression once it is low enough */
+static void damping_decay(damp_t* d, long now) {
+    if(config.half_life_sec > 0)
+        d->penalty *= pow(0.5, (now - d->last_decay_ms) / (1000.0 * config.half_life_sec));
+    d->last_decay_ms = now;
+
+    if(d->suppressed && d->penalty < config.reuse_limit) {
+        d->suppressed = 0;
+        fprintf(stderr, "Route flap damping: reusing route to %08x (penalty %.0f)\n",
+                d->subnet, d->penalty);
+    }
+}
+
+void damping_configure(const dr_damping_config_t* new_config) {
+    config = *new_config;
+}
+
+void damping_withdrawn(uint32_t subnet, uint32_t cost) {
+    long now = damping_now_ms();
+    damp_t* d = damping_find(subnet);
+
+    if(config.penalty_per_flap == 0 && config.holddown_sec == 0)
+        return; /* both disabled */
+
+    if(d == NULL) {
+        d = (damp_t*) calloc(1, sizeof(damp_t));
+        if(d == NULL)
+            return; /* without state the route is just not damped */
+        d->subnet = subnet;
+        d->last_decay_ms = now;
+        d->next = head_damp;
+        head_damp = d;
+    }
+
+    damping_decay(d, now);
+    d->penalty += config.penalty_per_flap;
+    if(d->penalty > config.max_penalty)
+        d->penalty = config.max_penalty;
+    if(!d->suppressed && config.penalty_per_flap > 0 && d->penalty > config.suppress_limit) {
+        d->suppressed = 1;
+        fprintf(stderr, "Route flap damping: suppressing route to %08x (penalty %.0f)\n",
+                subnet, d->penalty);
+    }
+
+    d->holddown_until_ms = now + config.holddown_sec * 1000L;
+    d->withdrawn_cost = cost;
+}
+
+int damping_may_install(uint32_t subnet, uint32_t cost) {
+    long now = damping_now_ms();
+    damp_t* d = damping_find(subnet);
+
+    if(d == NULL)
+        return 1;
+
+    damping_decay(d, now);
+    if(d->suppressed)
+        return 0;
+    if(now < d->holddown_until_ms && cost >= d->withdrawn_cost)
+        return 0;
+    return 1;
+}
+
+void damping_periodic() {
+    long now = damping_now_ms();
+    damp_t* current = head_damp;
+    damp_t** link = &head_damp;
+
+    while(current != NULL) {
+        damping_decay(current, now);
+        if(!current->suppressed && now >= current->holddown_until_ms
+           && current->penalty < config.reuse_limit / 2) {
+            *link = current->next;
+            free(current);
+        }
+        else {
+            link = &current->next;
+        }
+        current = *link;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * Filename: dr_damping.h
+ * Purpose:  Route flap damping (in the spirit of RFC 2439) and RIP hold-down.
+ *
+ * Every withdrawal of a learned route adds to a penalty kept per destination,
+ * which decays exponentially over time.  While the penalty is above the
+ * suppress limit, the route is not installed again (and hence neither used nor
+ * advertised) until it has decayed below the reuse limit.  Independently, for a
+ * while after each withdrawal only strictly better routes are accepted, which
+ * keeps stale alternatives from being picked up while the withdrawal spreads.
+ *
+ * These functions are not thread-safe; the DR API calls them under its lock.
+ */
+
+#ifndef _DR_DAMPING_H_
+#define _DR_DAMPING_H_
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif
+
+#include "dr_api.h"
+
+/** Replaces the damping parameters (see dr_configure_damping). */
+void damping_configure(const dr_damping_config_t* config);
+
+/** Notes that the route to subnet, which had the given cost, was withdrawn. */
+void damping_withdrawn(uint32_t subnet, uint32_t cost);
+
+/**
+ * Returns non-zero if a route to subnet with the given cost may be installed
+ * now, i.e. it is neither suppressed nor held down.
+ */
+int damping_may_install(uint32_t subnet, uint32_t cost);
+
+/** Forgets destinations which have been stable long enough. */
+void damping_periodic();
+
+#endif /* _DR_DAMPING_H_ */
@@ -0,0 +1,294 @@
+/*
+ * Filename: dr_replay.c
+ * Purpose:  Feed a trace recorded with DR_TRACE_FILE (see dr_trace.h) back into
+ *           libdr, report throughput and per-call latency and check the
+ *           resulting routing table against the recorded one.
+ *
+ * Usage:    ./dr_replay [-m] [-v] TRACE
+ *           -m  replay as fast as possible instead of at the recorded speed;
+ *               the table is not checked then, since timeouts and damping
+ *               in the library follow the wall clock, not the trace
+ *           -v  keep the library's own output (it is discarded otherwise)
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dr_api.h"
+#include "dr_trace.h"
+
+/* the interfaces of the replayed router, as of the current record */
+static uint32_t num_interfaces = 0;
+static lvns_interface_t* interfaces = NULL;
+static pthread_mutex_t interfaces_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* number of payloads the library sent */
+static unsigned long num_sent = 0;
+
+/* where the results go, stdout and stderr belong to the library */
+static FILE* report = NULL;
+
+/* latency of every replayed call, in nanoseconds */
+static uint64_t* latencies = NULL;
+static unsigned long num_latencies = 0;
+static unsigned long max_latencies = 0;
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static unsigned replay_interface_count() {
+    return num_interfaces;
+}
+
+static lvns_interface_t replay_get_interface(unsigned index) {
+    lvns_interface_t intf;
+
+    memset(&intf, 0, sizeof(intf));
+    pthread_mutex_lock(&interfaces_lock);
+    if(index < num_interfaces)
+        intf = interfaces[index];
+    pthread_mutex_unlock(&interfaces_lock);
+    return intf;
+}
+
+static void replay_send_payload(uint32_t dst_ip, uint32_t next_hop_ip,
+                                uint32_t outgoing_intf,
+                                char* buf /* borrowed */, unsigned len) {
+    __sync_fetch_and_add(&num_sent, 1);
+}
+
+static void set_interface(uint32_t index, dr_trace_intf_t t) {
+    pthread_mutex_lock(&interfaces_lock);
+    if(index < num_interfaces) {
+        interfaces[index].ip = t.ip;
+        interfaces[index].subnet_mask = t.subnet_mask;
+        interfaces[index].cost = t.cost;
+        interfaces[index].enabled = t.enabled;
+    }
+    pthread_mutex_unlock(&interfaces_lock);
+}
+
+static void add_latency(uint64_t ns) {
+    if(num_latencies == max_latencies) {
+        max_latencies = max_latencies ? 2 * max_latencies : 4096;
+        latencies = (uint64_t*) realloc(latencies, max_latencies * sizeof(uint64_t));
+        if(latencies == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    latencies[num_latencies++] = ns;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* returns the number of recorded routes whose next hop differs from ours */
+static unsigned check_table(const dr_trace_table_t* table, int verbose) {
+    unsigned mismatches = 0;
+    uint32_t i;
+
+    for(i = 0; i < table->num_routes; i++) {
+        const dr_trace_route_t* route = &table->routes[i];
+        next_hop_t hop = dr_get_next_hop(route->subnet);
+
+        if(hop.interface != route->hop.interface || hop.dst_ip != route->hop.dst_ip) {
+            mismatches += 1;
+            if(verbose)
+                fprintf(report, "mismatch for subnet %08x: recorded intf %u via %08x, "
+                        "replayed intf %u via %08x\n", route->subnet,
+                        route->hop.interface, route->hop.dst_ip,
+                        hop.interface, hop.dst_ip);
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    dr_trace_file_header_t header;
+    dr_trace_record_t record;
+    char* body = NULL;
+    dr_trace_table_t* last_table = NULL;
+    unsigned last_mismatches = 0, tables_checked = 0, tables_mismatched = 0;
+    unsigned long num_packets = 0, num_intf_changes = 0;
+    uint64_t start, elapsed, busy = 0;
+    int max_speed = 0, verbose = 0, opt;
+    FILE* in;
+
+    while((opt = getopt(argc, argv, "mv")) != -1) {
+        if(opt == 'm') {
+            max_speed = 1;
+        }
+        else if(opt == 'v') {
+            verbose = 1;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-m] [-v] TRACE\n", argv[0]);
+            return 2;
+        }
+    }
+    if(optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-m] [-v] TRACE\n", argv[0]);
+        return 2;
+    }
+
+    /* do not record the replay itself */
+    unsetenv(DR_TRACE_ENV);
+
+    in = fopen(argv[optind], "rb");
+    if(in == NULL) {
+        perror(argv[optind]);
+        return 2;
+    }
+    if(fread(&header, sizeof(header), 1, in) != 1 || header.magic != DR_TRACE_MAGIC
+       || header.version != DR_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d DR trace\n", argv[optind], DR_TRACE_VERSION);
+        return 2;
+    }
+    if(!dr_trace_read(in, &record, &body) || record.type != DR_TRACE_INIT
+       || record.len < sizeof(dr_trace_init_t)) {
+        fprintf(stderr, "%s: trace does not start with the interfaces\n", argv[optind]);
+        return 2;
+    }
+
+    dr_trace_init_t* init = (dr_trace_init_t*) body;
+    if((record.len - sizeof(dr_trace_init_t)) / sizeof(dr_trace_intf_t) < init->num_interfaces) {
+        fprintf(stderr, "%s: trace does not start with the interfaces\n", argv[optind]);
+        return 2;
+    }
+    interfaces = (lvns_interface_t*) calloc(init->num_interfaces + 1, sizeof(lvns_interface_t));
+    num_interfaces = init->num_interfaces;
+    for(uint32_t i = 0; i < init->num_interfaces; i++)
+        set_interface(i, init->interfaces[i]);
+
+    /* the library prints its table on every change, keep that out of the way */
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if(!verbose) {
+        int devnull = open("/dev/null", O_WRONLY);
+        fflush(stdout);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        close(devnull);
+    }
+
+    dr_init(replay_interface_count, replay_get_interface, replay_send_payload);
+
+    start = now_ns();
+    while(dr_trace_read(in, &record, &body)) {
+        uint64_t call_start, call_ns;
+
+        if(!max_speed) {
+            uint64_t due = start + record.timestamp_ns;
+            uint64_t now = now_ns();
+            if(due > now) {
+                struct timespec delay;
+                delay.tv_sec = (due - now) / 1000000000ULL;
+                delay.tv_nsec = (due - now) % 1000000000ULL;
+                nanosleep(&delay, NULL);
+            }
+        }
+
+        switch(record.type) {
+        case DR_TRACE_PACKET: {
+            dr_trace_packet_t* packet = (dr_trace_packet_t*) body;
+            if(record.len < sizeof(dr_trace_packet_t))
+                goto malformed;
+            call_start = now_ns();
+            dr_handle_packet(packet->ip, packet->intf, packet->payload,
+                             record.len - sizeof(dr_trace_packet_t));
+            call_ns = now_ns() - call_start;
+            add_latency(call_ns);
+            busy += call_ns;
+            num_packets += 1;
+            break;
+        }
+        case DR_TRACE_INTF: {
+            dr_trace_intf_changed_t* change = (dr_trace_intf_changed_t*) body;
+            if(record.len < sizeof(dr_trace_intf_changed_t))
+                goto malformed;
+            set_interface(change->intf, change->state);
+            call_start = now_ns();
+            dr_interface_changed(change->intf, change->state_changed, change->cost_changed);
+            call_ns = now_ns() - call_start;
+            add_latency(call_ns);
+            busy += call_ns;
+            num_intf_changes += 1;
+            break;
+        }
+        case DR_TRACE_TABLE:
+            if(record.len < sizeof(dr_trace_table_t)
+               || (record.len - sizeof(dr_trace_table_t)) / sizeof(dr_trace_route_t)
+                  < ((dr_trace_table_t*) body)->num_routes)
+                goto malformed;
+            if(max_speed)
+                break; /* see the usage above */
+            /* keep the snapshot; the last one is reported in detail below */
+            last_table = (dr_trace_table_t*) realloc(last_table, record.len);
+            memcpy(last_table, body, record.len);
+            last_mismatches = check_table(last_table, 0);
+            tables_checked += 1;
+            tables_mismatched += (last_mismatches > 0);
+            break;
+        default:
+            fprintf(report, "skipping record of unknown type %d\n", record.type);
+        }
+        continue;
+    malformed:
+        fprintf(report, "skipping malformed record of type %d (%u bytes)\n",
+                record.type, record.len);
+    }
+    elapsed = now_ns() - start;
+
+    fprintf(report, "replayed %lu packets and %lu interface changes in %.3f s (%s)\n",
+           num_packets, num_intf_changes, elapsed / 1e9,
+           max_speed ? "max speed" : "recorded speed");
+    /* give the sender thread up to a second to drain its queue */
+    dr_send_stats_t send_stats;
+    for(int i = 0; i < 100; i++) {
+        dr_get_send_stats(&send_stats);
+        if(send_stats.sent + send_stats.merged >= send_stats.queued)
+            break;
+        usleep(10000);
+    }
+    fprintf(report, "payloads sent by libdr: %lu (peak %lu/s, %lu merged, %lu dropped)\n",
+            num_sent, (unsigned long)send_stats.peak_per_sec,
+            (unsigned long)send_stats.merged, (unsigned long)send_stats.dropped);
+    if(num_latencies > 0) {
+        qsort(latencies, num_latencies, sizeof(uint64_t), compare_u64);
+        fprintf(report, "throughput: %.0f calls/s (%.0f calls/s while in libdr)\n",
+               num_latencies / (elapsed / 1e9), num_latencies / (busy / 1e9));
+        fprintf(report, "latency (us): min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+               latencies[0] / 1e3, busy / 1e3 / num_latencies,
+               latencies[num_latencies / 2] / 1e3,
+               latencies[num_latencies * 99 / 100] / 1e3,
+               latencies[num_latencies - 1] / 1e3);
+    }
+
+    if(max_speed) {
+        fprintf(report, "routing table: not checked at max speed\n");
+        return 0;
+    }
+    if(last_table == NULL) {
+        fprintf(report, "routing table: no snapshot in the trace, not checked\n");
+        return 0;
+    }
+    fprintf(report, "routing table: %u of %u snapshots differed\n", tables_mismatched, tables_checked);
+    if(last_mismatches > 0) {
+        check_table(last_table, 1);
+        fprintf(report, "routing table: FAILED, %u of %u routes differ in the final snapshot\n",
+               last_mismatches, last_table->num_routes);
+        return 1;
+    }
+    fprintf(report, "routing table: OK, final snapshot matches (%u routes)\n", last_table->num_routes);
+    return 0;
+}
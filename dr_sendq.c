@@ -0,0 +1,212 @@
+/* Filename: dr_sendq.c */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "dr_sendq.h"
+
+/* RIP framing, as far as merging needs it (see dr_api.c) */
+#define RIP_HEADER_LEN       4
+#define RIP_MAX_ENTRIES      25
+#define RIP_COMMAND_RESPONSE 2
+
+/**
+ * One queued payload.  The slot is free for the producer claiming position pos
+ * when seq == pos, and ready for the consumer when seq == pos + 1 (Vyukov's
+ * bounded queue).
+ */
+typedef struct sendq_slot_t {
+    uint64_t seq;
+    uint32_t dst_ip;
+    uint32_t next_hop_ip;
+    uint32_t outgoing_intf;
+    unsigned len;
+    char buf[SENDQ_MAX_PAYLOAD];
+} sendq_slot_t;
+
+static sendq_slot_t slots[SENDQ_SLOTS];
+static uint64_t enqueue_pos = 0;  /* shared by the producers */
+static uint64_t dequeue_pos = 0;  /* only touched by the sender thread */
+/* wakes the sender thread; a condition variable rather than a semaphore, as
+ * unnamed semaphores do not exist on every platform (e.g. Darwin) */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cv = PTHREAD_COND_INITIALIZER;
+static unsigned pending = 0;      /* payloads pushed since the sender last woke */
+static sendq_send_fn send_payload;
+static unsigned entry_len;        /* size of one RIP entry */
+
+static dr_send_stats_t stats;     /* updated atomically */
+
+/* sends in the current second, only touched by the sender thread */
+static time_t rate_window = 0;
+static uint64_t rate_count = 0;
+
+/* the payloads taken off the queue in one go, only used by the sender thread */
+static sendq_slot_t batch[SENDQ_SLOTS];
+static int batch_sent[SENDQ_SLOTS];
+
+/* takes the next ready payload off the queue; returns 0 if there is none */
+static int sendq_pop(sendq_slot_t* out) {
+    sendq_slot_t* slot = &slots[dequeue_pos & (SENDQ_SLOTS - 1)];
+
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != dequeue_pos + 1)
+        return 0;
+
+    out->dst_ip = slot->dst_ip;
+    out->next_hop_ip = slot->next_hop_ip;
+    out->outgoing_intf = slot->outgoing_intf;
+    out->len = slot->len;
+    memcpy(out->buf, slot->buf, slot->len);
+
+    /* hand the slot back to the producers for the next lap */
+    __atomic_store_n(&slot->seq, dequeue_pos + SENDQ_SLOTS, __ATOMIC_RELEASE);
+    dequeue_pos++;
+    return 1;
+}
+
+/* non-zero if b's entries can be appended to the packet a */
+static int sendq_can_merge(const sendq_slot_t* a, const sendq_slot_t* b) {
+    return a->outgoing_intf == b->outgoing_intf
+        && a->dst_ip == b->dst_ip && a->next_hop_ip == b->next_hop_ip
+        && a->len >= RIP_HEADER_LEN && b->len >= RIP_HEADER_LEN
+        && a->buf[0] == RIP_COMMAND_RESPONSE && b->buf[0] == RIP_COMMAND_RESPONSE
+        && a->len + b->len - RIP_HEADER_LEN <= RIP_HEADER_LEN + RIP_MAX_ENTRIES * entry_len;
+}
+
+/* keeps track of the highest number of sends within one second */
+static void sendq_count_rate() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec != rate_window) {
+        rate_window = now.tv_sec;
+        rate_count = 0;
+    }
+    rate_count++;
+    if(rate_count > __atomic_load_n(&stats.peak_per_sec, __ATOMIC_RELAXED))
+        __atomic_store_n(&stats.peak_per_sec, rate_count, __ATOMIC_RELAXED);
+}
+
+/* sends a batch, merging each run of responses which follow each other on the
+ * same interface; the order of the payloads of one interface is kept */
+static void sendq_send_batch(unsigned num) {
+    unsigned i, j;
+
+    memset(batch_sent, 0, num * sizeof(int));
+    for(i = 0; i < num; i++) {
+        if(batch_sent[i])
+            continue;
+
+        for(j = i + 1; j < num; j++) {
+            if(batch_sent[j] || batch[j].outgoing_intf != batch[i].outgoing_intf)
+                continue; /* other interfaces may be overtaken */
+
+            /* merging past a payload for the same interface which cannot be
+             * merged (a request, or no room left) would send j before it */
+            if(!sendq_can_merge(&batch[i], &batch[j]))
+                break;
+
+            memcpy(batch[i].buf + batch[i].len, batch[j].buf + RIP_HEADER_LEN,
+                   batch[j].len - RIP_HEADER_LEN);
+            batch[i].len += batch[j].len - RIP_HEADER_LEN;
+            batch_sent[j] = 1;
+            __atomic_fetch_add(&stats.merged, 1, __ATOMIC_RELAXED);
+        }
+
+        send_payload(batch[i].dst_ip, batch[i].next_hop_ip, batch[i].outgoing_intf,
+                     batch[i].buf, batch[i].len);
+        __atomic_fetch_add(&stats.sent, 1, __ATOMIC_RELAXED);
+        sendq_count_rate();
+    }
+}
+
+static void* sendq_main(void* nil) {
+    unsigned num;
+
+    while(1) {
+        pthread_mutex_lock(&pending_lock);
+        while(pending == 0)
+            pthread_cond_wait(&pending_cv, &pending_lock);
+        pending = 0;
+        pthread_mutex_unlock(&pending_lock);
+
+        /* take everything which is ready; payloads published after this
+         * start another round */
+        num = 0;
+        while(num < SENDQ_SLOTS && sendq_pop(&batch[num]))
+            num++;
+        if(num > 0)
+            sendq_send_batch(num);
+    }
+
+    return NULL;
+}
+
+int sendq_init(sendq_send_fn send, unsigned rip_entry_len) {
+    pthread_t tid;
+    unsigned i;
+
+    send_payload = send;
+    entry_len = rip_entry_len;
+    for(i = 0; i < SENDQ_SLOTS; i++)
+        slots[i].seq = i;
+
+    if(pthread_create(&tid, NULL, sendq_main, NULL) != 0) {
+        fprintf(stderr, "pthread_create failed in sendq_init\n");
+        return -1;
+    }
+    return 0;
+}
+
+void sendq_push(uint32_t dst_ip, uint32_t next_hop_ip, uint32_t outgoing_intf,
+                char* buf /* borrowed */, unsigned len) {
+    uint64_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    sendq_slot_t* slot;
+
+    if(len > SENDQ_MAX_PAYLOAD) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    /* claim a slot */
+    while(1) {
+        slot = &slots[pos & (SENDQ_SLOTS - 1)];
+        int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(diff < 0) { /* full: the sender is a whole lap behind */
+            __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->dst_ip = dst_ip;
+    slot->next_hop_ip = next_hop_ip;
+    slot->outgoing_intf = outgoing_intf;
+    slot->len = len;
+    memcpy(slot->buf, buf, len);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&stats.queued, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pending_lock);
+    pending += 1;
+    pthread_cond_signal(&pending_cv);
+    pthread_mutex_unlock(&pending_lock);
+}
+
+void sendq_get_stats(dr_send_stats_t* out) {
+    out->queued = __atomic_load_n(&stats.queued, __ATOMIC_RELAXED);
+    out->sent = __atomic_load_n(&stats.sent, __ATOMIC_RELAXED);
+    out->merged = __atomic_load_n(&stats.merged, __ATOMIC_RELAXED);
+    out->dropped = __atomic_load_n(&stats.dropped, __ATOMIC_RELAXED);
+    out->peak_per_sec = __atomic_load_n(&stats.peak_per_sec, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,48 @@
+/*
+ * Filename: dr_sendq.h
+ * Purpose:  Bounded lock-free multi-producer single-consumer queue of outbound
+ *           DR payloads.  A dedicated sender thread drains it, so the payloads
+ *           handed to the DR's send function never go out while the DR API's
+ *           lock is held.  Responses queued back to back for the same
+ *           interface (payloads for other interfaces in between do not
+ *           matter) are merged into one packet on the way out, without ever
+ *           changing the order of the payloads of an interface.
+ */
+
+#ifndef _DR_SENDQ_H_
+#define _DR_SENDQ_H_
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif
+
+#include "dr_api.h"
+
+#define SENDQ_SLOTS       256 /* must be a power of two */
+#define SENDQ_MAX_PAYLOAD 1024 /* a RIP header and 25 (traced) entries fit */
+
+/** the DR's function for sending payloads, see dr_init */
+typedef void (*sendq_send_fn)(uint32_t dst_ip, uint32_t next_hop_ip,
+                              uint32_t outgoing_intf,
+                              char* /* borrowed */, unsigned);
+
+/**
+ * Starts the sender thread which passes queued payloads on to send.  Responses
+ * are merged as long as no more than 25 entries of rip_entry_len bytes end up
+ * in one packet.  Returns 0 on success.
+ */
+int sendq_init(sendq_send_fn send, unsigned rip_entry_len);
+
+/**
+ * Queues a copy of the payload; same arguments as sendq_send_fn.  Never waits
+ * for the sender: if the queue is full (or the payload too big) it is dropped
+ * and counted.  Only waking the sender takes a lock, briefly.  May be called
+ * from any thread.
+ */
+void sendq_push(uint32_t dst_ip, uint32_t next_hop_ip, uint32_t outgoing_intf,
+                char* buf /* borrowed */, unsigned len);
+
+/** Copies the queue's counters to stats. */
+void sendq_get_stats(dr_send_stats_t* stats);
+
+#endif /* _DR_SENDQ_H_ */
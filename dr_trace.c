@@ -0,0 +1,123 @@
+/* Filename: dr_trace.c */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dr_trace.h"
+
+/* size of the stdio buffer; the trace is flushed with every table snapshot */
+#define DR_TRACE_BUFFER_SIZE (256 * 1024)
+
+static FILE* trace_file = NULL;
+static uint64_t trace_start_ns;
+
+static uint64_t trace_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* writes a record made of two parts (e.g. fixed fields and a payload) */
+static void trace_write(uint8_t type, const void* part1, uint32_t len1,
+                        const void* part2, uint32_t len2) {
+    dr_trace_record_t record;
+
+    record.type = type;
+    record.len = len1 + len2;
+    record.timestamp_ns = trace_now_ns() - trace_start_ns;
+    fwrite(&record, sizeof(record), 1, trace_file);
+    if(len1 > 0) fwrite(part1, len1, 1, trace_file);
+    if(len2 > 0) fwrite(part2, len2, 1, trace_file);
+}
+
+dr_trace_intf_t dr_trace_intf(lvns_interface_t intf) {
+    dr_trace_intf_t t;
+
+    t.ip = intf.ip;
+    t.subnet_mask = intf.subnet_mask;
+    t.cost = intf.cost;
+    t.enabled = (intf.enabled != 0);
+    return t;
+}
+
+int dr_trace_open(const char* path, uint32_t num_interfaces,
+                  const dr_trace_intf_t* interfaces) {
+    dr_trace_file_header_t header;
+    char name[1024];
+    const char* pid = strstr(path, "%d");
+
+    /* a %d in the path is replaced by our pid, so that routers started from
+     * the same shell (see launch_dr.sh) do not write to the same file */
+    if(pid != NULL)
+        snprintf(name, sizeof(name), "%.*s%d%s", (int)(pid - path), path,
+                 (int)getpid(), pid + 2);
+    else
+        snprintf(name, sizeof(name), "%s", path);
+
+    trace_file = fopen(name, "wb");
+    if(trace_file == NULL) {
+        perror("dr_trace_open");
+        return -1;
+    }
+    setvbuf(trace_file, NULL, _IOFBF, DR_TRACE_BUFFER_SIZE);
+    trace_start_ns = trace_now_ns();
+
+    header.magic = DR_TRACE_MAGIC;
+    header.version = DR_TRACE_VERSION;
+    fwrite(&header, sizeof(header), 1, trace_file);
+    trace_write(DR_TRACE_INIT, &num_interfaces, sizeof(num_interfaces),
+                interfaces, num_interfaces * sizeof(dr_trace_intf_t));
+    fflush(trace_file);
+    return 0;
+}
+
+int dr_trace_enabled() {
+    return trace_file != NULL;
+}
+
+void dr_trace_packet(uint32_t ip, unsigned intf,
+                     const char* buf /* borrowed */, unsigned len) {
+    dr_trace_packet_t packet;
+
+    if(trace_file == NULL) return;
+    packet.ip = ip;
+    packet.intf = intf;
+    trace_write(DR_TRACE_PACKET, &packet, sizeof(packet), buf, len);
+}
+
+void dr_trace_interface_changed(unsigned intf, int state_changed,
+                                int cost_changed, lvns_interface_t state) {
+    dr_trace_intf_changed_t change;
+
+    if(trace_file == NULL) return;
+    change.intf = intf;
+    change.state_changed = (state_changed != 0);
+    change.cost_changed = (cost_changed != 0);
+    change.state = dr_trace_intf(state);
+    trace_write(DR_TRACE_INTF, &change, sizeof(change), NULL, 0);
+    fflush(trace_file);
+}
+
+void dr_trace_table(const dr_trace_route_t* routes, uint32_t num_routes) {
+    if(trace_file == NULL) return;
+    trace_write(DR_TRACE_TABLE, &num_routes, sizeof(num_routes),
+                routes, num_routes * sizeof(dr_trace_route_t));
+    fflush(trace_file);
+}
+
+int dr_trace_read(FILE* in, dr_trace_record_t* record, char** body) {
+    if(fread(record, sizeof(*record), 1, in) != 1)
+        return 0;
+
+    *body = (char*) realloc(*body, record->len > 0 ? record->len : 1);
+    if(*body == NULL) {
+        perror("dr_trace_read");
+        return 0;
+    }
+    if(record->len > 0 && fread(*body, record->len, 1, in) != 1)
+        return 0;
+
+    return 1;
+}
@@ -0,0 +1,116 @@
+/*
+ * Filename: dr_trace.h
+ * Purpose:  Record the calls made into the DR API to a compact, append-only
+ *           binary trace which dr_replay can feed back into the library.
+ *
+ * Recording is off unless the DR_TRACE_FILE environment variable names the
+ * file to write when dr_init is called (a %d in it is replaced by the process
+ * id).  The trace starts with a
+ * dr_trace_file_header_t followed by records, each a dr_trace_record_t and
+ * len bytes of body.  All fields are in host byte order, except for the
+ * addresses and payloads which are stored exactly as the library sees them.
+ */
+
+#ifndef _DR_TRACE_H_
+#define _DR_TRACE_H_
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif
+#include <stdio.h>
+
+#include "lvns_types.h"
+
+#define DR_TRACE_ENV     "DR_TRACE_FILE"
+#define DR_TRACE_MAGIC   0x52545244 /* "DRTR" */
+#define DR_TRACE_VERSION 1
+
+/* record types */
+#define DR_TRACE_INIT    1 /* body: dr_trace_init_t, the interfaces at dr_init */
+#define DR_TRACE_PACKET  2 /* body: dr_trace_packet_t, a dr_handle_packet call */
+#define DR_TRACE_INTF    3 /* body: dr_trace_intf_changed_t                    */
+#define DR_TRACE_TABLE   4 /* body: dr_trace_table_t, routing table snapshot   */
+
+/** first bytes of every trace file */
+typedef struct dr_trace_file_header_t {
+    uint32_t magic;
+    uint32_t version;
+} __attribute__ ((packed)) dr_trace_file_header_t;
+
+/** header of every record */
+typedef struct dr_trace_record_t {
+    uint8_t  type;
+    uint32_t len;          /* number of body bytes following this header */
+    uint64_t timestamp_ns; /* CLOCK_MONOTONIC, relative to the start of the trace */
+} __attribute__ ((packed)) dr_trace_record_t;
+
+/** state of one interface */
+typedef struct dr_trace_intf_t {
+    uint32_t ip;
+    uint32_t subnet_mask;
+    uint32_t cost;
+    uint8_t  enabled;
+} __attribute__ ((packed)) dr_trace_intf_t;
+
+typedef struct dr_trace_init_t {
+    uint32_t num_interfaces;
+    dr_trace_intf_t interfaces[0];
+} __attribute__ ((packed)) dr_trace_init_t;
+
+typedef struct dr_trace_packet_t {
+    uint32_t ip;   /* source of the packet */
+    uint32_t intf; /* interface it arrived on */
+    char payload[0];
+} __attribute__ ((packed)) dr_trace_packet_t;
+
+typedef struct dr_trace_intf_changed_t {
+    uint32_t intf;
+    uint8_t  state_changed;
+    uint8_t  cost_changed;
+    dr_trace_intf_t state; /* the interface after the change */
+} __attribute__ ((packed)) dr_trace_intf_changed_t;
+
+/** a route as seen through dr_get_next_hop(subnet) */
+typedef struct dr_trace_route_t {
+    uint32_t subnet;
+    uint32_t mask;
+    uint32_t cost;
+    next_hop_t hop;
+} __attribute__ ((packed)) dr_trace_route_t;
+
+typedef struct dr_trace_table_t {
+    uint32_t num_routes;
+    dr_trace_route_t routes[0];
+} __attribute__ ((packed)) dr_trace_table_t;
+
+/** Converts an interface to its trace representation. */
+dr_trace_intf_t dr_trace_intf(lvns_interface_t intf);
+
+/**
+ * Starts recording to path and writes the DR_TRACE_INIT record.  Returns 0 on
+ * success.  The functions below do nothing unless a trace is open.
+ */
+int dr_trace_open(const char* path, uint32_t num_interfaces,
+                  const dr_trace_intf_t* interfaces);
+
+/** Returns non-zero if a trace is being recorded. */
+int dr_trace_enabled();
+
+void dr_trace_packet(uint32_t ip, unsigned intf,
+                     const char* buf /* borrowed */, unsigned len);
+
+void dr_trace_interface_changed(unsigned intf, int state_changed,
+                                int cost_changed, lvns_interface_t state);
+
+/** Records a snapshot of the table and flushes the trace to disk. */
+void dr_trace_table(const dr_trace_route_t* routes, uint32_t num_routes);
+
+/**
+ * Reads the next record from a trace opened for reading (after its file
+ * header).  *body is (re)allocated to hold the record's body and must be freed
+ * by the caller.  Returns 0 at the end of the trace or if the last record was
+ * cut short, 1 otherwise.
+ */
+int dr_trace_read(FILE* in, dr_trace_record_t* record, char** body);
+
+#endif /* _DR_TRACE_H_ */
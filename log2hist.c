@@ -0,0 +1,24 @@
+/* Filename: log2hist.c */
+
+#include "log2hist.h"
+
+unsigned log2hist_bucket(uint64_t ns, unsigned num_buckets) {
+    uint64_t usecs = ns / 1000;
+    unsigned bucket = 0;
+    while(usecs > 0 && bucket < num_buckets - 1) {
+        usecs >>= 1;
+        bucket += 1;
+    }
+    return bucket;
+}
+
+void log2hist_dump(FILE* out, const char* name, const uint64_t* hist,
+                   unsigned num_buckets) {
+    unsigned i;
+
+    fprintf(out, "    %s (usecs):", name);
+    for(i = 0; i < num_buckets; i++)
+        if(hist[i] > 0)
+            fprintf(out, " <%lu:%lu", 1UL << i, (unsigned long)hist[i]);
+    fprintf(out, "\n");
+}
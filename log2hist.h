@@ -0,0 +1,22 @@
+/*
+ * Filename: log2hist.h
+ * Purpose:  Histograms of durations with power-of-two buckets, as used by the
+ *           lock profile (rmutex.h) and the convergence trace (dr_convtrace.h).
+ *           Bucket i counts durations in [2^(i-1), 2^i) usecs; the last bucket
+ *           also counts everything longer.
+ */
+
+#ifndef _LOG2HIST_H_
+#define _LOG2HIST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** Returns the bucket of a histogram with num_buckets buckets for ns. */
+unsigned log2hist_bucket(uint64_t ns, unsigned num_buckets);
+
+/** Writes the non-empty buckets of hist to out on one line labelled name. */
+void log2hist_dump(FILE* out, const char* name, const uint64_t* hist,
+                   unsigned num_buckets);
+
+#endif /* _LOG2HIST_H_ */
@@ -4,28 +4,98 @@
 #include <pthread.h>
 #include "rmutex.h"
 
+#ifdef RMUTEX_PROFILE
+#include <string.h>
+#include <time.h>
+#include "log2hist.h"
+
+static uint64_t profile_now_ns() {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* finds (or adds) the stats of a call site; must hold control_mutex */
+static rmutex_site_stats_t* profile_site( rmutex_t* lock, const char* site ) {
+    rmutex_profile_t* profile = &lock->profile;
+    unsigned i;
+
+    for( i = 0; i < profile->num_sites; i++ )
+        if( profile->sites[i].site == site || !strcmp( profile->sites[i].site, site ) )
+            return &profile->sites[i];
+
+    if( profile->num_sites == RMUTEX_PROFILE_MAX_SITES ) {
+        profile->sites[RMUTEX_PROFILE_MAX_SITES - 1].site = "(other)";
+        return &profile->sites[RMUTEX_PROFILE_MAX_SITES - 1];
+    }
+
+    profile->sites[profile->num_sites].site = site;
+    return &profile->sites[profile->num_sites++];
+}
+#endif
 
 void rmutex_init( rmutex_t* lock ) {
     lock->lock_depth = 0;
 
     pthread_cond_init( &lock->control_cv, NULL );
     pthread_mutex_init( &lock->control_mutex, NULL );
+
+#ifdef RMUTEX_PROFILE
+    lock->acquired_ns = 0;
+    lock->holder = NULL;
+    memset( &lock->profile, 0, sizeof(lock->profile) );
+#endif
 }
 
+#ifdef RMUTEX_PROFILE
+void rmutex_lock_at( rmutex_t* lock, const char* site ) {
+    uint64_t start = profile_now_ns();
+    int contended = 0;
+#else
 void rmutex_lock( rmutex_t* lock ) {
+#endif
     pthread_mutex_lock( &lock->control_mutex );
 
     /* wait until the recursive lock is unlocked by its owner */
-    while( lock->lock_depth > 0 && lock->owner != pthread_self() )
+    while( lock->lock_depth > 0 && lock->owner != pthread_self() ) {
+#ifdef RMUTEX_PROFILE
+        contended = 1;
+#endif
         pthread_cond_wait( &lock->control_cv, &lock->control_mutex );
+    }
 
     if( lock->lock_depth == 0 ) { /* lock was free */
         lock->owner = pthread_self();
         lock->lock_depth = 1;
+
+#ifdef RMUTEX_PROFILE
+        rmutex_site_stats_t* stats = profile_site( lock, site );
+        uint64_t now = profile_now_ns();
+        uint64_t wait = now - start;
+
+        stats->acquisitions += 1;
+        stats->contended += contended;
+        stats->wait_ns_total += wait;
+        if( wait > stats->wait_ns_max )
+            stats->wait_ns_max = wait;
+        stats->wait_hist[log2hist_bucket( wait, RMUTEX_PROFILE_BUCKETS )] += 1;
+
+        lock->acquired_ns = now;
+        lock->holder = stats;
+        if( lock->profile.max_lock_depth < 1 )
+            lock->profile.max_lock_depth = 1;
+#endif
     }
-    else if( lock->owner == pthread_self() ) /* recursively locking it */
+    else if( lock->owner == pthread_self() ) { /* recursively locking it */
         lock->lock_depth += 1;
 
+#ifdef RMUTEX_PROFILE
+        profile_site( lock, site )->recursive += 1;
+        if( lock->lock_depth > lock->profile.max_lock_depth )
+            lock->profile.max_lock_depth = lock->lock_depth;
+#endif
+    }
+
     pthread_mutex_unlock( &lock->control_mutex );
 }
 
@@ -38,8 +108,22 @@ void rmutex_unlock( rmutex_t* lock ) {
     lock->lock_depth -= 1;
 
     /* wake up those waiting on the lock if we completely released it */
-    if( lock->lock_depth == 0 )
+    if( lock->lock_depth == 0 ) {
+#ifdef RMUTEX_PROFILE
+        /* the hold time is charged to the site of the outermost lock */
+        uint64_t hold = profile_now_ns() - lock->acquired_ns;
+        rmutex_site_stats_t* stats = lock->holder;
+
+        if( stats ) {
+            stats->hold_ns_total += hold;
+            if( hold > stats->hold_ns_max )
+                stats->hold_ns_max = hold;
+            stats->hold_hist[log2hist_bucket( hold, RMUTEX_PROFILE_BUCKETS )] += 1;
+            lock->holder = NULL;
+        }
+#endif
         pthread_cond_signal( &lock->control_cv );
+    }
 
     pthread_mutex_unlock( &lock->control_mutex );
 }
@@ -48,3 +132,48 @@ void rmutex_destroy( rmutex_t* lock ) {
     pthread_cond_destroy( &lock->control_cv );
     pthread_mutex_destroy( &lock->control_mutex );
 }
+
+#ifdef RMUTEX_PROFILE
+void rmutex_profile_dump( rmutex_t* lock, FILE* out ) {
+    rmutex_profile_t profile;
+    int holder;
+    unsigned i;
+
+    /* take a snapshot so we do not hold up lockers while printing */
+    pthread_mutex_lock( &lock->control_mutex );
+    profile = lock->profile;
+    holder = lock->holder ? (int)(lock->holder - lock->profile.sites) : -1;
+    pthread_mutex_unlock( &lock->control_mutex );
+
+    fprintf( out, "rmutex profile: max recursion depth %d\n", profile.max_lock_depth );
+    for( i = 0; i < profile.num_sites; i++ ) {
+        rmutex_site_stats_t* s = &profile.sites[i];
+        uint64_t held = s->acquisitions - (holder == (int)i); /* still being held */
+
+        fprintf( out, "  %s: %lu acquisitions (%lu contended, %lu recursive)\n",
+                 s->site, (unsigned long)s->acquisitions,
+                 (unsigned long)s->contended, (unsigned long)s->recursive );
+        fprintf( out, "    wait avg %lu ns max %lu ns, hold avg %lu ns max %lu ns\n",
+                 (unsigned long)(s->acquisitions ? s->wait_ns_total / s->acquisitions : 0),
+                 (unsigned long)s->wait_ns_max,
+                 (unsigned long)(held ? s->hold_ns_total / held : 0),
+                 (unsigned long)s->hold_ns_max );
+        log2hist_dump( out, "wait", s->wait_hist, RMUTEX_PROFILE_BUCKETS );
+        log2hist_dump( out, "hold", s->hold_hist, RMUTEX_PROFILE_BUCKETS );
+    }
+}
+
+void rmutex_profile_reset( rmutex_t* lock ) {
+    const char* site;
+
+    pthread_mutex_lock( &lock->control_mutex );
+    site = lock->holder ? lock->holder->site : NULL;
+    memset( &lock->profile, 0, sizeof(lock->profile) );
+    lock->holder = NULL;
+    if( site ) { /* the current owner's hold time goes to the fresh stats */
+        lock->holder = profile_site( lock, site );
+        lock->holder->acquisitions = 1;
+    }
+    pthread_mutex_unlock( &lock->control_mutex );
+}
+#endif
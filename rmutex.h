@@ -2,11 +2,44 @@
  * File: rmutex.h
  * Purpose: build a recursive lock out of pthread_mutex_t (support for
  *          recursive mutex locks is sparse in general).
+ *
+ * When compiled with RMUTEX_PROFILE defined, every rmutex also keeps
+ * contention statistics per call site (the function which locked it).  Without
+ * it, none of the profiling code or fields exist.
  */
 
 #ifndef _RMUTEX_H_
 #define _RMUTEX_H_
 
+#ifdef RMUTEX_PROFILE
+#include <stdint.h>
+#include <stdio.h>
+
+#define RMUTEX_PROFILE_MAX_SITES 16 /* further call sites share the last slot */
+#define RMUTEX_PROFILE_BUCKETS   24 /* bucket i counts [2^(i-1), 2^i) usecs */
+
+/** contention statistics of one call site */
+typedef struct {
+    const char* site;        /* name of the function which took the lock  */
+    uint64_t acquisitions;   /* outermost (non-recursive) acquisitions     */
+    uint64_t recursive;      /* acquisitions by the thread already owning it */
+    uint64_t contended;      /* acquisitions which had to wait for an owner */
+    uint64_t wait_ns_total;
+    uint64_t wait_ns_max;
+    uint64_t hold_ns_total;
+    uint64_t hold_ns_max;
+    uint64_t wait_hist[RMUTEX_PROFILE_BUCKETS];
+    uint64_t hold_hist[RMUTEX_PROFILE_BUCKETS];
+} rmutex_site_stats_t;
+
+/** all statistics kept for one rmutex */
+typedef struct {
+    int max_lock_depth;
+    unsigned num_sites;
+    rmutex_site_stats_t sites[RMUTEX_PROFILE_MAX_SITES];
+} rmutex_profile_t;
+#endif
+
 /* recursive mutex data type */
 typedef struct {
     int lock_depth;          /* 0 means not locked or owned   */
@@ -15,16 +48,33 @@ typedef struct {
     /* objects to synchronize methods which operate on rmutex */
     pthread_cond_t  control_cv;
     pthread_mutex_t control_mutex;
+
+#ifdef RMUTEX_PROFILE
+    uint64_t acquired_ns;           /* when the owner took the lock   */
+    rmutex_site_stats_t* holder;    /* call site of the current owner */
+    rmutex_profile_t profile;       /* protected by control_mutex     */
+#endif
 } rmutex_t;
 
 /** Initializes the rmutex. */
 void rmutex_init( rmutex_t* lock );
 
+/**
+ * Statically initializes an rmutex, e.g. one which may be locked before the
+ * code which would call rmutex_init runs.  The profile starts out empty.
+ */
+#define RMUTEX_INITIALIZER { 0, 0, PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER }
+
 /**
  * Locks the lock.  May be done recursively by the same thread (but it needs to
  * call rmutex_unlock an equal number of times to release the lock).
  */
+#ifdef RMUTEX_PROFILE
+void rmutex_lock_at( rmutex_t* lock, const char* site );
+#define rmutex_lock( lock ) rmutex_lock_at( (lock), __func__ )
+#else
 void rmutex_lock( rmutex_t* lock );
+#endif
 
 /**
  * Unlocks the lock.  If it was locked multiple times, this unlocks only one of
@@ -35,4 +85,18 @@ void rmutex_unlock( rmutex_t* lock );
 /** Desroys the lock. */
 void rmutex_destroy( rmutex_t* lock );
 
+#ifdef RMUTEX_PROFILE
+/**
+ * Writes the acquisition counts, wait and hold time histograms of every call
+ * site and the maximum recursion depth seen so far to out.
+ */
+void rmutex_profile_dump( rmutex_t* lock, FILE* out );
+
+/** Clears the statistics collected so far. */
+void rmutex_profile_reset( rmutex_t* lock );
+#else
+#define rmutex_profile_dump( lock, out )  ((void) 0)
+#define rmutex_profile_reset( lock )      ((void) 0)
+#endif
+
 #endif /* _RMUTEX_H_ */